@@ -1,4 +1,7 @@
+#include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <pwd.h>
 #include <stdarg.h>
 #include <stdbool.h>
@@ -6,29 +9,135 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/socket.h>
-#include <sys/time.h>
 #include <sys/uio.h>
 #include <sys/un.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "aerospace.h"
+#include "latency.h"
+#include "log.h"
 #include "yyjson.h"
 
 #define READ_BUFFER_SIZE 8192
 #define SOCKET_TIMEOUT_SECS 2
+#define MAX_LIST_WAITERS 4
+#define WORKSPACE_TEMPLATES 32 // direct switches use one per workspace name
+#define RECONNECT_BACKOFF_MIN_SECS 0.05
+#define RECONNECT_BACKOFF_MAX_SECS 2.0
+#define SUBSCRIBE_RETRY_SECS 5.0
 
 static const char* ERROR_SOCKET_RECEIVE = "Failed to receive data from socket";
 static const char* ERROR_SOCKET_CLOSE = "Failed to close socket connection";
-static const char* ERROR_JSON_PRINT = "Failed to print JSON to string";
+
+// A command written to the socket whose response has not arrived yet.
+typedef struct {
+	uint64_t id;
+	const char* expected_output_field;
+	aerospace_callback callback;
+	void* context;
+	double sent_at;
+} pending_request;
+
+typedef struct {
+	aerospace_model_callback callback;
+	void* context;
+} model_waiter;
+
+enum {
+	LIST_ALL,
+	LIST_OCCUPIED,
+	LIST_FOCUSED, // sent last, so its reply completes the model
+	LIST_REQUESTS
+};
+
+typedef struct {
+	aerospace* client;
+	workspace_model model;
+	workspace_model building; // filled in as the list replies of a fetch arrive
+	bool has_model;
+	bool building_ok;
+	double fetched_at;
+	double occupied_at; // occupancy has no events, so it is refreshed on its own
+	uint64_t fetch_id; // LIST_FOCUSED request of the most recent fetch
+	bool fetch_pending;
+	uint64_t occupied_id; // LIST_OCCUPIED request of the most recent occupancy refresh
+	bool occupied_pending;
+	uint64_t valid_after_id; // replies to older requests are not cached
+	uint64_t local_focus_id; // last switch sent by aerospace_set_focused_workspace()
+	char local_focus[WORKSPACE_NAME_MAX];
+	model_waiter waiters[MAX_LIST_WAITERS];
+	int waiter_count;
+} workspace_cache;
+
+// One per socket. Owned by the read source, so the fd stays open until the
+// source is cancelled even if the client has already reconnected.
+typedef struct {
+	aerospace* client;
+	int fd;
+	dispatch_source_t read_source;
+} connection;
+
+// Second socket carrying only `subscribe` events. Owned by its read source
+// like `connection`.
+typedef struct {
+	aerospace* client;
+	int fd;
+	dispatch_source_t read_source;
+	bool live; // AeroSpace accepted the subscription
+	char buf[READ_BUFFER_SIZE];
+	size_t len;
+} subscription;
+
+// `workspace <ws_command> [--wrap-around]`, serialized on first use.
+typedef struct {
+	aerospace_request request;
+	char ws_command[64];
+	int wrap_around;
+	bool used;
+} workspace_template;
 
 struct aerospace {
 	int fd;
 	char* socket_path;
 	char read_buf[READ_BUFFER_SIZE];
 	size_t read_buf_len;
-	unsigned int command_count;
+	dispatch_queue_t queue;
+	connection* conn;
+	dispatch_source_t timeout_timer;
+	dispatch_source_t reconnect_timer;
+	double reconnect_backoff;
+	double disconnected_at;
+	unsigned int failed_attempts; // since the connection was lost
+	bool closing;
+	pending_request pending[AEROSPACE_MAX_IN_FLIGHT];
+	unsigned int pending_head;
+	unsigned int pending_count;
+	uint64_t next_id;
+	workspace_cache workspaces;
+	aerospace_request list_requests[LIST_REQUESTS];
+	subscription* sub;
+	aerospace_request subscribe_request;
+	bool subscribe_unsupported;
+	bool subscribing; // an attempt is connecting off the client queue
+	int subscribe_fd; // ...and hands its socket over in this
+	dispatch_group_t subscribe_group; // attempts still running, waited for by aerospace_close()
+	double next_subscribe_at;
+	workspace_template workspace_templates[WORKSPACE_TEMPLATES];
+	unsigned int next_template;
+	char stdin_buf[READ_BUFFER_SIZE]; // escaped stdin of the command being written
+	void* parse_pool; // backs every response doc, sized for a full read_buf
+	size_t parse_pool_size;
+	aerospace_stats stats;
 };
 
+static double monotonic_seconds(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
 static void fatal_error(const char* fmt, ...)
 {
 	va_list args;
@@ -74,7 +183,7 @@ static char* get_default_socket_path(void)
 }
 
 // Connect to the AeroSpace Unix socket.
-// Returns fd on success, -1 on failure.
+// Returns a non-blocking fd on success, -1 on failure.
 static int connect_socket(const char* socket_path)
 {
 	errno = 0;
@@ -94,209 +203,648 @@ static int connect_socket(const char* socket_path)
 		return -1;
 	}
 
-	// Set read timeout to prevent indefinite hangs on stale sockets
-	struct timeval timeout;
-	timeout.tv_sec = SOCKET_TIMEOUT_SECS;
-	timeout.tv_usec = 0;
-	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	// Responses are read from a dispatch source; timeouts are tracked per
+	// request instead of with SO_RCVTIMEO.
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
 
 	return fd;
 }
 
-// Reconnect the socket. Closes existing fd and opens a fresh connection.
-// Returns 1 on success, 0 on failure.
-static int reconnect(aerospace* client)
+static void arm_timeout(aerospace* client)
 {
-	if (!client || !client->socket_path)
-		return 0;
+	if (!client->pending_count) {
+		dispatch_source_set_timer(client->timeout_timer, DISPATCH_TIME_FOREVER, DISPATCH_TIME_FOREVER, 0);
+		return;
+	}
 
-	if (client->fd >= 0) {
-		close(client->fd);
-		client->fd = -1;
+	double deadline = client->pending[client->pending_head].sent_at + SOCKET_TIMEOUT_SECS;
+	double remaining = deadline - monotonic_seconds();
+	if (remaining < 0)
+		remaining = 0;
+	dispatch_source_set_timer(client->timeout_timer,
+		dispatch_time(DISPATCH_TIME_NOW, (int64_t)(remaining * NSEC_PER_SEC)),
+		DISPATCH_TIME_FOREVER, NSEC_PER_SEC / 20);
+}
+
+static void call_back(const pending_request* req, int exit_code, const char* output)
+{
+	os_signpost_interval_end(g_latency_log, req->id, "request", "exit=%d", exit_code);
+	if (exit_code != AEROSPACE_EXIT_TRANSPORT)
+		latency_record(LATENCY_ACK, latency_from_seconds(req->sent_at), latency_from_seconds(monotonic_seconds()));
+
+	if (req->callback)
+		req->callback(req->context, req->id, exit_code, output);
+}
+
+// Pops the oldest request before calling back, so the callback may send more.
+static void complete_request(aerospace* client, int exit_code, const char* output)
+{
+	pending_request req = client->pending[client->pending_head];
+	client->pending_head = (client->pending_head + 1) % AEROSPACE_MAX_IN_FLIGHT;
+	client->pending_count--;
+	arm_timeout(client);
+	call_back(&req, exit_code, output);
+}
+
+// Takes every request in flight off the client before failing them: a
+// callback may reconnect and send more, which are in flight on the new
+// socket and must not be failed with these.
+static void fail_pending(aerospace* client)
+{
+	pending_request failed[AEROSPACE_MAX_IN_FLIGHT];
+	unsigned int count = client->pending_count;
+	for (unsigned int i = 0; i < count; ++i)
+		failed[i] = client->pending[(client->pending_head + i) % AEROSPACE_MAX_IN_FLIGHT];
+	client->pending_head = client->pending_count = 0;
+	arm_timeout(client);
+
+	for (unsigned int i = 0; i < count; ++i)
+		call_back(&failed[i], AEROSPACE_EXIT_TRANSPORT, NULL);
+}
+
+static void close_connection(void* context)
+{
+	connection* conn = context;
+	errno = 0;
+	if (close(conn->fd) < 0) {
+		log_error("%s: %s (errno %d)\n", ERROR_SOCKET_CLOSE, strerror(errno), errno);
+	}
+	free(conn);
+}
+
+static void schedule_reconnect(aerospace* client, double delay)
+{
+	if (client->closing)
+		return;
+
+	dispatch_source_set_timer(client->reconnect_timer,
+		dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)),
+		DISPATCH_TIME_FOREVER, (uint64_t)(delay * NSEC_PER_SEC / 10));
+}
+
+// Drops the connection and hands recovery to the background reconnect
+// timer, so the next command normally finds a fresh socket waiting.
+static void disconnect(aerospace* client)
+{
+	bool was_connected = client->conn != NULL;
+	if (client->conn) {
+		dispatch_source_cancel(client->conn->read_source);
+		dispatch_release(client->conn->read_source);
+		client->conn = NULL;
 	}
+	client->fd = -1;
 	client->read_buf_len = 0;
-	client->command_count = 0;
+	aerospace_invalidate_workspaces(client);
 
-	client->fd = connect_socket(client->socket_path);
-	if (client->fd < 0) {
-		fprintf(stderr, "Reconnect failed: %s (errno %d)\n", strerror(errno), errno);
-		return 0;
+	if (was_connected) {
+		client->disconnected_at = monotonic_seconds();
+		client->failed_attempts = 0;
+		client->reconnect_backoff = RECONNECT_BACKOFF_MIN_SECS;
+		schedule_reconnect(client, 0);
 	}
 
-	return 1;
+	// Last, as the callbacks may already reconnect
+	fail_pending(client);
 }
 
-static char* execute_aerospace_command(aerospace* client, const char** args, int arg_count, const char* stdin_payload, const char* expected_output_field)
+// Parses every complete response in read_buf, in request order.
+static void drain_responses(aerospace* client)
 {
-	if (!client || !args || arg_count == 0) {
-		errno = EINVAL;
-		fprintf(stderr, "execute_aerospace_command: Invalid arguments\n");
-		return NULL;
+	while (client->read_buf_len > 0) {
+		// Responses are newline-terminated; drop the separator between them
+		size_t skip = 0;
+		while (skip < client->read_buf_len && isspace((unsigned char)client->read_buf[skip]))
+			skip++;
+		if (skip) {
+			memmove(client->read_buf, client->read_buf + skip, client->read_buf_len - skip);
+			client->read_buf_len -= skip;
+			continue;
+		}
+
+		if (!client->pending_count) {
+			log_warn("Discarding %zu unsolicited bytes from AeroSpace\n", client->read_buf_len);
+			client->read_buf_len = 0;
+			return;
+		}
+
+		// One response is alive at a time, so the pool is simply reset
+		yyjson_alc alc;
+		yyjson_alc_pool_init(&alc, client->parse_pool, client->parse_pool_size);
+		yyjson_read_err err;
+		yyjson_doc* resp_doc = yyjson_read_opts(client->read_buf, client->read_buf_len, YYJSON_READ_STOP_WHEN_DONE, &alc, &err);
+		if (!resp_doc) {
+			// Incomplete response: wait for more bytes, unless there is no room.
+			if (client->read_buf_len >= READ_BUFFER_SIZE) {
+				log_error("Error: Read buffer overflow, dropping connection.\n");
+				disconnect(client);
+			}
+			return;
+		}
+
+		size_t parsed_bytes = yyjson_doc_get_read_size(resp_doc);
+		if (client->read_buf_len > parsed_bytes) {
+			memmove(client->read_buf, client->read_buf + parsed_bytes, client->read_buf_len - parsed_bytes);
+		}
+		client->read_buf_len -= parsed_bytes;
+
+		const char* field = client->pending[client->pending_head].expected_output_field;
+		yyjson_val* resp_root = yyjson_doc_get_root(resp_doc);
+		yyjson_val* exitCodeItem = yyjson_obj_get(resp_root, "exitCode");
+		if (!yyjson_is_int(exitCodeItem)) {
+			log_error("Response does not contain valid exitCode field\n");
+			yyjson_doc_free(resp_doc);
+			complete_request(client, AEROSPACE_EXIT_TRANSPORT, NULL);
+			continue;
+		}
+
+		int exitCode = (int)yyjson_get_int(exitCodeItem);
+		const char* output = NULL;
+		if (exitCode != 0) {
+			yyjson_val* output_item = yyjson_obj_get(resp_root, "stderr");
+			if (yyjson_is_str(output_item))
+				output = yyjson_get_str(output_item);
+		} else if (field) {
+			yyjson_val* output_item = yyjson_obj_get(resp_root, field);
+			if (yyjson_is_str(output_item))
+				output = yyjson_get_str(output_item);
+		}
+
+		complete_request(client, exitCode, output);
+		yyjson_doc_free(resp_doc);
+
+		// A callback may have dropped the connection
+		if (client->fd < 0)
+			return;
 	}
+}
 
-	if (client->fd < 0) {
-		fprintf(stderr, "Socket not connected\n");
-		return NULL;
+// Reads whatever the socket has without blocking.
+// Returns 0 if the connection was lost.
+static int read_available(aerospace* client)
+{
+	while (client->read_buf_len < READ_BUFFER_SIZE) {
+		ssize_t bytes_read = read(client->fd, client->read_buf + client->read_buf_len, READ_BUFFER_SIZE - client->read_buf_len);
+		if (bytes_read > 0) {
+			client->read_buf_len += bytes_read;
+			continue;
+		}
+		if (bytes_read < 0 && errno == EINTR)
+			continue;
+		if (bytes_read < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			return 1;
+
+		if (bytes_read == 0) {
+			log_error("%s: connection closed by AeroSpace\n", ERROR_SOCKET_RECEIVE);
+		} else {
+			log_error("%s: %s (errno %d)\n", ERROR_SOCKET_RECEIVE, strerror(errno), errno);
+		}
+		disconnect(client);
+		return 0;
 	}
+	return 1;
+}
+
+static void on_readable(void* context)
+{
+	connection* conn = context;
+	aerospace* client = conn->client;
+	if (client->conn != conn)
+		return;
 
-	yyjson_mut_doc* doc = yyjson_mut_doc_new(NULL);
-	yyjson_mut_val* root = yyjson_mut_obj(doc);
-	yyjson_mut_doc_set_root(doc, root);
-	yyjson_mut_obj_add_str(doc, root, "command", args[0]);
-	yyjson_mut_obj_add_str(doc, root, "stdin", stdin_payload ? stdin_payload : "");
-	yyjson_mut_val* args_array = yyjson_mut_arr(doc);
-	for (int i = 0; i < arg_count; i++) {
-		yyjson_mut_arr_add_str(doc, args_array, args[i]);
+	if (read_available(client))
+		drain_responses(client);
+}
+
+static void on_timeout(void* context)
+{
+	aerospace* client = context;
+	if (!client->pending_count)
+		return;
+
+	double deadline = client->pending[client->pending_head].sent_at + SOCKET_TIMEOUT_SECS;
+	if (monotonic_seconds() < deadline) {
+		arm_timeout(client);
+		return;
 	}
-	yyjson_mut_obj_add_val(doc, root, "args", args_array);
-	size_t len;
-	const char* json_str = yyjson_mut_write(doc, 0, &len);
-	yyjson_mut_doc_free(doc);
-	if (!json_str) {
-		fatal_error(ERROR_JSON_PRINT);
-	}
-
-	struct iovec iov[2];
-	char newline = '\n';
-	iov[0].iov_base = (void*)json_str;
-	iov[0].iov_len = len;
-	iov[1].iov_base = &newline;
-	iov[1].iov_len = 1;
-
-	if (writev(client->fd, iov, 2) < 0) {
-		fprintf(stderr, "Socket write failed: %s (errno %d)\n", strerror(errno), errno);
-		free((void*)json_str);
-		close(client->fd);
-		client->fd = -1;
-		client->read_buf_len = 0;
-		return NULL;
+
+	log_error("%s: read timeout (%ds)\n", ERROR_SOCKET_RECEIVE, SOCKET_TIMEOUT_SECS);
+	disconnect(client);
+}
+
+static void subscribe(aerospace* client);
+static void unsubscribe(aerospace* client, double retry_after);
+
+static void attach(aerospace* client, int fd)
+{
+	connection* conn = malloc(sizeof(connection));
+	conn->client = client;
+	conn->fd = fd;
+	conn->read_source = dispatch_source_create(DISPATCH_SOURCE_TYPE_READ, fd, 0, client->queue);
+	dispatch_set_context(conn->read_source, conn);
+	dispatch_source_set_event_handler_f(conn->read_source, on_readable);
+	dispatch_source_set_cancel_handler_f(conn->read_source, close_connection);
+	dispatch_resume(conn->read_source);
+
+	client->conn = conn;
+	client->fd = fd;
+	subscribe(client);
+}
+
+// Returns 1 if a new connection was established.
+static int try_connect(aerospace* client)
+{
+	double started = monotonic_seconds();
+	int fd = connect_socket(client->socket_path);
+	if (fd < 0) {
+		if (client->failed_attempts++ == 0)
+			log_error("Reconnect failed: %s (errno %d). Retrying in the background.\n", strerror(errno), errno);
+		client->stats.reconnect_failures++;
+		return 0;
 	}
-	free((void*)json_str);
+	attach(client, fd);
 
-	client->command_count++;
+	double finished = monotonic_seconds();
+	double connect_ms = (finished - started) * 1000.0;
+	double outage_ms = (finished - client->disconnected_at) * 1000.0;
+	client->stats.reconnects++;
+	client->stats.last_connect_ms = connect_ms;
+	if (connect_ms > client->stats.max_connect_ms)
+		client->stats.max_connect_ms = connect_ms;
+	client->stats.last_outage_ms = outage_ms;
+	client->failed_attempts = 0;
+	client->reconnect_backoff = RECONNECT_BACKOFF_MIN_SECS;
+	dispatch_source_set_timer(client->reconnect_timer, DISPATCH_TIME_FOREVER, DISPATCH_TIME_FOREVER, 0);
+	return 1;
+}
 
-	yyjson_doc* resp_doc = NULL;
-	yyjson_read_err err;
-	size_t parsed_bytes = 0;
+static void on_reconnect_timer(void* context)
+{
+	aerospace* client = context;
+	if (client->fd >= 0 || client->closing)
+		return;
 
-	while (true) {
-		if (client->read_buf_len > 0) {
-			resp_doc = yyjson_read_opts(client->read_buf, client->read_buf_len, YYJSON_READ_STOP_WHEN_DONE, NULL, &err);
-			if (resp_doc) {
-				parsed_bytes = yyjson_doc_get_read_size(resp_doc);
-				break;
+	if (try_connect(client)) {
+		log_info("Reconnected to AeroSpace\n");
+		return;
+	}
+
+	schedule_reconnect(client, client->reconnect_backoff);
+	client->reconnect_backoff *= 2;
+	if (client->reconnect_backoff > RECONNECT_BACKOFF_MAX_SECS)
+		client->reconnect_backoff = RECONNECT_BACKOFF_MAX_SECS;
+}
+
+// writev() that survives a full socket buffer on the non-blocking fd.
+static int write_all(int fd, struct iovec* iov, int iov_count)
+{
+	double deadline = monotonic_seconds() + SOCKET_TIMEOUT_SECS;
+	while (iov_count > 0) {
+		ssize_t written = writev(fd, iov, iov_count);
+		if (written < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN && errno != EWOULDBLOCK)
+				return 0;
+
+			int remaining_ms = (int)((deadline - monotonic_seconds()) * 1000);
+			struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+			if (remaining_ms <= 0 || poll(&pfd, 1, remaining_ms) <= 0) {
+				errno = ETIMEDOUT;
+				return 0;
 			}
+			continue;
 		}
-		if (client->read_buf_len >= READ_BUFFER_SIZE) {
-			fprintf(stderr, "Error: Read buffer overflow, clearing buffer.\n");
-			client->read_buf_len = 0;
-			return NULL;
+
+		while (iov_count > 0 && (size_t)written >= iov->iov_len) {
+			written -= iov->iov_len;
+			iov++;
+			iov_count--;
 		}
-		ssize_t bytes_read = read(client->fd, client->read_buf + client->read_buf_len, READ_BUFFER_SIZE - client->read_buf_len);
-		if (bytes_read <= 0) {
-			if (bytes_read == 0) {
-				fprintf(stderr, "%s: connection closed by AeroSpace\n", ERROR_SOCKET_RECEIVE);
-			} else if (errno == EAGAIN || errno == EWOULDBLOCK) {
-				fprintf(stderr, "%s: read timeout (%ds)\n", ERROR_SOCKET_RECEIVE, SOCKET_TIMEOUT_SECS);
-			} else {
-				fprintf(stderr, "%s: %s (errno %d)\n", ERROR_SOCKET_RECEIVE, strerror(errno), errno);
-			}
-			close(client->fd);
-			client->fd = -1;
-			client->read_buf_len = 0;
-			return NULL;
+		if (iov_count > 0) {
+			iov->iov_base = (char*)iov->iov_base + written;
+			iov->iov_len -= written;
 		}
-		client->read_buf_len += bytes_read;
 	}
+	return 1;
+}
 
-	if (client->read_buf_len > parsed_bytes) {
-		memmove(client->read_buf, client->read_buf + parsed_bytes, client->read_buf_len - parsed_bytes);
+static bool json_append_raw(char* out, size_t cap, size_t* len, const char* s)
+{
+	size_t n = strlen(s);
+	if (*len + n > cap)
+		return false;
+	memcpy(out + *len, s, n);
+	*len += n;
+	return true;
+}
+
+// Appends `s` as the body of a JSON string. Returns false if it does not fit.
+static bool json_append_escaped(char* out, size_t cap, size_t* len, const char* s)
+{
+	static const char hex[] = "0123456789abcdef";
+	size_t n = *len;
+	for (const unsigned char* p = (const unsigned char*)s; *p; ++p) {
+		char esc = 0;
+		switch (*p) {
+			case '"':
+				esc = '"';
+				break;
+			case '\\':
+				esc = '\\';
+				break;
+			case '\n':
+				esc = 'n';
+				break;
+			case '\r':
+				esc = 'r';
+				break;
+			case '\t':
+				esc = 't';
+				break;
+			case '\b':
+				esc = 'b';
+				break;
+			case '\f':
+				esc = 'f';
+				break;
+		}
+
+		if (esc) {
+			if (n + 2 > cap)
+				return false;
+			out[n++] = '\\';
+			out[n++] = esc;
+		} else if (*p < 0x20) {
+			if (n + 6 > cap)
+				return false;
+			memcpy(out + n, "\\u00", 4);
+			out[n + 4] = hex[*p >> 4];
+			out[n + 5] = hex[*p & 0xf];
+			n += 6;
+		} else {
+			if (n + 1 > cap)
+				return false;
+			out[n++] = (char)*p;
+		}
 	}
-	client->read_buf_len -= parsed_bytes;
+	*len = n;
+	return true;
+}
 
-	yyjson_val* resp_root = yyjson_doc_get_root(resp_doc);
-	char* result = NULL;
-	int exitCode = -1;
-	yyjson_val* exitCodeItem = yyjson_obj_get(resp_root, "exitCode");
-	if (yyjson_is_int(exitCodeItem)) {
-		exitCode = (int)yyjson_get_int(exitCodeItem);
-	} else {
-		fprintf(stderr, "Response does not contain valid exitCode field\n");
-		yyjson_doc_free(resp_doc);
-		return NULL;
+bool aerospace_request_init(aerospace_request* req, const char** args, int arg_count, const char* expected_output_field)
+{
+	if (!req || !args || arg_count == 0)
+		return false;
+
+	char* out = req->prefix;
+	size_t cap = sizeof(req->prefix);
+	size_t len = 0;
+	bool ok = json_append_raw(out, cap, &len, "{\"command\":\"")
+		&& json_append_escaped(out, cap, &len, args[0])
+		&& json_append_raw(out, cap, &len, "\",\"args\":[");
+	for (int i = 0; ok && i < arg_count; i++) {
+		ok = (i == 0 || json_append_raw(out, cap, &len, ","))
+			&& json_append_raw(out, cap, &len, "\"")
+			&& json_append_escaped(out, cap, &len, args[i])
+			&& json_append_raw(out, cap, &len, "\"");
 	}
+	ok = ok && json_append_raw(out, cap, &len, "],\"stdin\":\"");
 
-	if (exitCode != 0) {
-		yyjson_val* output_item = yyjson_obj_get(resp_root, "stderr");
-		if (yyjson_is_str(output_item)) {
-			result = strdup(yyjson_get_str(output_item));
-		}
-	} else if (expected_output_field) {
-		yyjson_val* output_item = yyjson_obj_get(resp_root, expected_output_field);
-		if (yyjson_is_str(output_item)) {
-			result = strdup(yyjson_get_str(output_item));
+	req->prefix_len = ok ? len : 0;
+	req->expected_output_field = expected_output_field;
+	return ok;
+}
+
+uint64_t aerospace_send_async(aerospace* client, const aerospace_request* req, const char* stdin_payload,
+	aerospace_callback callback, void* context)
+{
+	if (!client || !req || !req->prefix_len) {
+		errno = EINVAL;
+		log_error("aerospace_send_async: Invalid arguments\n");
+		return 0;
+	}
+
+	if (client->fd < 0) {
+		log_error("Socket not connected\n");
+		return 0;
+	}
+
+	if (client->pending_count >= AEROSPACE_MAX_IN_FLIGHT) {
+		log_error("Too many AeroSpace commands in flight (%d)\n", AEROSPACE_MAX_IN_FLIGHT);
+		return 0;
+	}
+
+	// Only the stdin payload varies per command; it is escaped into a
+	// client-owned buffer and spliced between the pre-serialized prefix and
+	// the fixed suffix.
+	size_t stdin_len = 0;
+	if (stdin_payload && !json_append_escaped(client->stdin_buf, sizeof(client->stdin_buf), &stdin_len, stdin_payload)) {
+		log_error("Error: stdin payload too large (%zu bytes)\n", strlen(stdin_payload));
+		return 0;
+	}
+
+	static const char suffix[] = "\"}\n";
+	struct iovec iov[3];
+	iov[0].iov_base = (void*)req->prefix;
+	iov[0].iov_len = req->prefix_len;
+	iov[1].iov_base = client->stdin_buf;
+	iov[1].iov_len = stdin_len;
+	iov[2].iov_base = (void*)suffix;
+	iov[2].iov_len = sizeof(suffix) - 1;
+
+	if (!write_all(client->fd, iov, 3)) {
+		log_error("Socket write failed: %s (errno %d)\n", strerror(errno), errno);
+		disconnect(client);
+		return 0;
+	}
+
+	unsigned int slot = (client->pending_head + client->pending_count) % AEROSPACE_MAX_IN_FLIGHT;
+	pending_request* pending = &client->pending[slot];
+	pending->id = ++client->next_id;
+	pending->expected_output_field = req->expected_output_field;
+	pending->callback = callback;
+	pending->context = context;
+	pending->sent_at = monotonic_seconds();
+	os_signpost_interval_begin(g_latency_log, pending->id, "request", "id=%llu", (unsigned long long)pending->id);
+
+	if (++client->pending_count == 1)
+		arm_timeout(client);
+	if (client->pending_count > client->stats.max_in_flight)
+		client->stats.max_in_flight = client->pending_count;
+
+	return pending->id;
+}
+
+uint64_t aerospace_command_async(aerospace* client, const char** args, int arg_count, const char* stdin_payload,
+	const char* expected_output_field, aerospace_callback callback, void* context)
+{
+	aerospace_request req;
+	if (!aerospace_request_init(&req, args, arg_count, expected_output_field)) {
+		errno = EINVAL;
+		log_error("aerospace_command_async: Invalid arguments\n");
+		return 0;
+	}
+	return aerospace_send_async(client, &req, stdin_payload, callback, context);
+}
+
+typedef struct {
+	bool done;
+	char* result;
+} sync_reply;
+
+static void on_sync_reply(void* context, __unused uint64_t request_id, __unused int exit_code, const char* output)
+{
+	sync_reply* reply = context;
+	reply->done = true;
+	reply->result = output ? strdup(output) : NULL;
+}
+
+// Blocking form of aerospace_command_async(): pumps the socket on the calling
+// (client) queue until this command's response, completing any earlier
+// pipelined requests on the way.
+static char* execute_aerospace_command(aerospace* client, const char** args, int arg_count, const char* stdin_payload, const char* expected_output_field)
+{
+	sync_reply reply = { 0 };
+	if (!aerospace_command_async(client, args, arg_count, stdin_payload, expected_output_field, on_sync_reply, &reply))
+		return NULL;
+
+	double deadline = monotonic_seconds() + SOCKET_TIMEOUT_SECS;
+	while (!reply.done && client->fd >= 0) {
+		int remaining_ms = (int)((deadline - monotonic_seconds()) * 1000);
+		struct pollfd pfd = { .fd = client->fd, .events = POLLIN };
+		int ready = remaining_ms > 0 ? poll(&pfd, 1, remaining_ms) : 0;
+		if (ready < 0 && errno == EINTR)
+			continue;
+		if (ready <= 0) {
+			log_error("%s: read timeout (%ds)\n", ERROR_SOCKET_RECEIVE, SOCKET_TIMEOUT_SECS);
+			disconnect(client);
+			break;
 		}
+		if (read_available(client))
+			drain_responses(client);
 	}
 
-	yyjson_doc_free(resp_doc);
-	return result;
+	return reply.result;
+}
+
+// Client queue. The first connect is kept off the caller's thread:
+// resolving the default socket path can wait on directory services right
+// after login.
+static void connect_first(void* context)
+{
+	aerospace* client = context;
+	if (!client->socket_path)
+		client->socket_path = get_default_socket_path();
+
+	int fd = connect_socket(client->socket_path);
+	if (fd < 0) {
+		log_warn("Warning: Could not connect to socket at %s: %s (errno %d). Will retry.\n",
+			client->socket_path, strerror(errno), errno);
+		client->disconnected_at = monotonic_seconds();
+		client->failed_attempts = 1;
+		schedule_reconnect(client, client->reconnect_backoff);
+	} else {
+		attach(client, fd);
+	}
 }
 
 aerospace* aerospace_new(const char* socketPath)
 {
-	aerospace* client = malloc(sizeof(aerospace));
+	aerospace* client = calloc(1, sizeof(aerospace));
 	client->fd = -1;
 	client->read_buf_len = 0;
-	client->command_count = 0;
+	client->workspaces.client = client;
+	workspace_model_reset(&client->workspaces.model);
+
+	const char* list_args[] = { "list-workspaces", "--monitor", "focused", "--empty", "no" };
+	const char* focused_args[] = { "list-workspaces", "--focused" };
+	aerospace_request_init(&client->list_requests[LIST_ALL], list_args, 3, "stdout");
+	aerospace_request_init(&client->list_requests[LIST_OCCUPIED], list_args, 5, "stdout");
+	aerospace_request_init(&client->list_requests[LIST_FOCUSED], focused_args, 2, "stdout");
+
+	const char* subscribe_args[] = { "subscribe", "focused-workspace-changed", "focused-monitor-changed", "window-detected" };
+	aerospace_request_init(&client->subscribe_request, subscribe_args, 4, NULL);
+
+	// The only allocation the client makes after startup-time setup
+	client->parse_pool_size = yyjson_read_max_memory_usage(READ_BUFFER_SIZE, YYJSON_READ_STOP_WHEN_DONE);
+	client->parse_pool = malloc(client->parse_pool_size);
 
 	if (socketPath)
 		client->socket_path = strdup(socketPath);
-	else
-		client->socket_path = get_default_socket_path();
 
-	client->fd = connect_socket(client->socket_path);
-	if (client->fd < 0) {
-		fprintf(stderr, "Warning: Could not connect to socket at %s: %s (errno %d). Will retry.\n",
-			client->socket_path, strerror(errno), errno);
-	}
+	client->subscribe_group = dispatch_group_create();
+	client->queue = dispatch_queue_create("com.acsandmann.swipe.aerospace",
+		dispatch_queue_attr_make_with_qos_class(DISPATCH_QUEUE_SERIAL, QOS_CLASS_USER_INITIATED, 0));
+
+	client->timeout_timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, client->queue);
+	dispatch_set_context(client->timeout_timer, client);
+	dispatch_source_set_event_handler_f(client->timeout_timer, on_timeout);
+	dispatch_source_set_timer(client->timeout_timer, DISPATCH_TIME_FOREVER, DISPATCH_TIME_FOREVER, 0);
+	dispatch_resume(client->timeout_timer);
+
+	client->reconnect_backoff = RECONNECT_BACKOFF_MIN_SECS;
+	client->reconnect_timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, client->queue);
+	dispatch_set_context(client->reconnect_timer, client);
+	dispatch_source_set_event_handler_f(client->reconnect_timer, on_reconnect_timer);
+	dispatch_source_set_timer(client->reconnect_timer, DISPATCH_TIME_FOREVER, DISPATCH_TIME_FOREVER, 0);
+	dispatch_resume(client->reconnect_timer);
+
+	// Queued ahead of everything else, so the first command already finds
+	// the socket connected (or the reconnect timer running).
+	dispatch_async_f(client->queue, client, connect_first);
 
 	return client;
 }
 
+dispatch_queue_t aerospace_queue(aerospace* client)
+{
+	return client ? client->queue : NULL;
+}
+
 int aerospace_ensure_connected(aerospace* client)
 {
 	if (!client)
 		return 0;
 
-	// Socket is dead - reconnect
-	if (client->fd < 0) {
-		fprintf(stderr, "Socket disconnected, reconnecting...\n");
-		if (reconnect(client))
-			fprintf(stderr, "Reconnected to AeroSpace\n");
-		return client->fd >= 0;
+	// A lost connection is noticed by the read source (EOF) and restored by
+	// the reconnect timer, so a healthy client answers without any I/O.
+	if (client->fd >= 0) {
+		subscribe(client);
+		return 1;
 	}
 
-	// Proactive: refresh socket every N commands to prevent staleness
-	if (client->command_count >= AEROSPACE_RECONNECT_INTERVAL) {
-		fprintf(stderr, "Proactive socket refresh after %u commands\n", client->command_count);
-		reconnect(client);
+	// Mid-outage: one immediate attempt, which fails fast on a Unix socket.
+	if (try_connect(client)) {
+		log_info("Reconnected to AeroSpace\n");
+		return 1;
 	}
 
-	return client->fd >= 0;
+	return 0;
+}
+
+static void close_on_queue(void* context)
+{
+	aerospace* client = context;
+	client->closing = true;
+	unsubscribe(client, 0);
+	disconnect(client);
+	dispatch_source_cancel(client->timeout_timer);
+	dispatch_source_cancel(client->reconnect_timer);
 }
 
 void aerospace_close(aerospace* client)
 {
 	if (client) {
-		if (client->fd >= 0) {
-			errno = 0;
-			if (close(client->fd) < 0) {
-				fprintf(stderr, "%s: %s (errno %d)\n", ERROR_SOCKET_CLOSE, strerror(errno), errno);
-			}
-			client->fd = -1;
-		}
+		// A finished attempt queues its hand-over ahead of close_on_queue
+		dispatch_group_wait(client->subscribe_group, DISPATCH_TIME_FOREVER);
+		dispatch_sync_f(client->queue, client, close_on_queue);
+		dispatch_release(client->timeout_timer);
+		dispatch_release(client->reconnect_timer);
+		dispatch_release(client->queue);
+		dispatch_release(client->subscribe_group);
 		free(client->socket_path);
 		client->socket_path = NULL;
+		free(client->parse_pool);
 		free(client);
 	}
 }
@@ -317,6 +865,44 @@ char* aerospace_workspace(aerospace* client, int wrap_around, const char* ws_com
 	return execute_aerospace_command(client, args, arg_count, stdin_payload, NULL);
 }
 
+static const aerospace_request* workspace_request(aerospace* client, int wrap_around, const char* ws_command)
+{
+	for (int i = 0; i < WORKSPACE_TEMPLATES; ++i) {
+		workspace_template* t = &client->workspace_templates[i];
+		if (t->used && t->wrap_around == wrap_around && strcmp(t->ws_command, ws_command) == 0)
+			return &t->request;
+	}
+
+	if (strlen(ws_command) >= sizeof(client->workspace_templates[0].ws_command))
+		return NULL;
+
+	workspace_template* t = &client->workspace_templates[client->next_template];
+	client->next_template = (client->next_template + 1) % WORKSPACE_TEMPLATES;
+
+	const char* args[3] = { "workspace", ws_command, "--wrap-around" };
+	t->used = aerospace_request_init(&t->request, args, wrap_around ? 3 : 2, NULL);
+	if (!t->used)
+		return NULL;
+	strcpy(t->ws_command, ws_command);
+	t->wrap_around = wrap_around;
+	return &t->request;
+}
+
+uint64_t aerospace_workspace_async(aerospace* client, int wrap_around, const char* ws_command,
+	const char* stdin_payload, aerospace_callback callback, void* context)
+{
+	if (!client || !ws_command)
+		return 0;
+
+	const aerospace_request* req = workspace_request(client, wrap_around, ws_command);
+	if (!req) {
+		// Unusually long target: serialize it just for this call
+		const char* args[3] = { "workspace", ws_command, "--wrap-around" };
+		return aerospace_command_async(client, args, wrap_around ? 3 : 2, stdin_payload, NULL, callback, context);
+	}
+	return aerospace_send_async(client, req, stdin_payload, callback, context);
+}
+
 char* aerospace_list_workspaces(aerospace* client, bool include_empty)
 {
 	if (include_empty) {
@@ -327,3 +913,410 @@ char* aerospace_list_workspaces(aerospace* client, bool include_empty)
 		return execute_aerospace_command(client, args, 5, "", "stdout");
 	}
 }
+
+static void on_all_listed(void* context, __unused uint64_t request_id, int exit_code, const char* output)
+{
+	workspace_cache* cache = context;
+	cache->building_ok = exit_code == 0 && workspace_model_parse_all(&cache->building, output);
+}
+
+static void on_occupied_listed(void* context, __unused uint64_t request_id, int exit_code, const char* output)
+{
+	workspace_cache* cache = context;
+	cache->building_ok = cache->building_ok && exit_code == 0;
+	if (cache->building_ok)
+		workspace_model_parse_occupied(&cache->building, output);
+}
+
+static void answer_waiters(workspace_cache* cache, const workspace_model* model)
+{
+	model_waiter waiters[MAX_LIST_WAITERS];
+	int waiter_count = cache->waiter_count;
+	memcpy(waiters, cache->waiters, sizeof(model_waiter) * waiter_count);
+	cache->waiter_count = 0;
+
+	for (int i = 0; i < waiter_count; ++i)
+		waiters[i].callback(waiters[i].context, model);
+}
+
+static void on_focused_listed(void* context, uint64_t request_id, int exit_code, const char* output)
+{
+	workspace_cache* cache = context;
+
+	// Superseded by a newer fetch, which will answer the waiters
+	if (request_id != cache->fetch_id)
+		return;
+
+	cache->fetch_pending = false;
+	bool ok = cache->building_ok && exit_code == 0;
+	if (ok) {
+		workspace_model_parse_focused(&cache->building, output);
+		// A switch sent before this fetch was answered has moved focus since
+		if (cache->local_focus_id > request_id)
+			cache->building.focused = workspace_model_find(&cache->building, cache->local_focus,
+				strlen(cache->local_focus));
+	}
+
+	if (request_id >= cache->valid_after_id) {
+		cache->has_model = ok;
+		if (ok)
+			cache->model = cache->building;
+		cache->fetched_at = cache->occupied_at = monotonic_seconds();
+	}
+
+	answer_waiters(cache, ok ? &cache->building : NULL);
+}
+
+// Reply to an occupancy-only refresh of a model the event stream keeps
+// current otherwise.
+static void on_occupied_refreshed(void* context, uint64_t request_id, int exit_code, const char* output)
+{
+	workspace_cache* cache = context;
+	if (request_id != cache->occupied_id)
+		return;
+
+	cache->occupied_pending = false;
+	bool ok = exit_code == 0 && cache->has_model && request_id >= cache->valid_after_id;
+	if (ok) {
+		workspace_model_parse_occupied(&cache->model, output);
+		cache->occupied_at = monotonic_seconds();
+	}
+
+	answer_waiters(cache, ok ? &cache->model : NULL);
+}
+
+// While the event stream is live the model is patched from events and only
+// expires after the much longer subscribed TTL. AeroSpace sends no event
+// when a window closes or moves to another workspace, so which workspaces
+// are empty always keeps the short TTL (occupancy_fresh()).
+static bool model_fresh(aerospace* client)
+{
+	workspace_cache* cache = &client->workspaces;
+	double ttl = client->sub && client->sub->live ? AEROSPACE_SUBSCRIBED_CACHE_TTL_SECS : AEROSPACE_WORKSPACE_CACHE_TTL_SECS;
+	return cache->has_model && monotonic_seconds() - cache->fetched_at <= ttl;
+}
+
+static bool occupancy_fresh(workspace_cache* cache)
+{
+	return monotonic_seconds() - cache->occupied_at <= AEROSPACE_WORKSPACE_CACHE_TTL_SECS;
+}
+
+static bool fetch_in_flight(workspace_cache* cache)
+{
+	return cache->fetch_pending && cache->fetch_id >= cache->valid_after_id;
+}
+
+static bool occupancy_in_flight(workspace_cache* cache)
+{
+	return fetch_in_flight(cache) || (cache->occupied_pending && cache->occupied_id >= cache->valid_after_id);
+}
+
+// One list-workspaces command, patched into the model in place.
+static bool start_occupancy_refresh(aerospace* client)
+{
+	workspace_cache* cache = &client->workspaces;
+	uint64_t id = aerospace_send_async(client, &client->list_requests[LIST_OCCUPIED], "", on_occupied_refreshed, cache);
+	if (!id)
+		return false;
+
+	cache->occupied_id = id;
+	cache->occupied_pending = true;
+	return true;
+}
+
+// Three pipelined list-workspaces commands; their replies arrive in order, so
+// the last one completes the model.
+static bool start_fetch(aerospace* client)
+{
+	workspace_cache* cache = &client->workspaces;
+	cache->building_ok = false;
+	if (!aerospace_send_async(client, &client->list_requests[LIST_ALL], "", on_all_listed, cache)
+		|| !aerospace_send_async(client, &client->list_requests[LIST_OCCUPIED], "", on_occupied_listed, cache))
+		return false;
+
+	uint64_t id = aerospace_send_async(client, &client->list_requests[LIST_FOCUSED], "", on_focused_listed, cache);
+	if (!id)
+		return false;
+
+	cache->fetch_id = id;
+	cache->fetch_pending = true;
+	return true;
+}
+
+void aerospace_prefetch_workspaces(aerospace* client)
+{
+	if (!client || client->fd < 0)
+		return;
+
+	if (fetch_in_flight(&client->workspaces))
+		return;
+
+	// Without events the model is refreshed on every arm so it is at most a
+	// gesture old when the commit reads it.
+	if (client->sub && client->sub->live && model_fresh(client)) {
+		if (!occupancy_fresh(&client->workspaces) && !occupancy_in_flight(&client->workspaces))
+			start_occupancy_refresh(client);
+		return;
+	}
+
+	start_fetch(client);
+}
+
+bool aerospace_workspace_model_async(aerospace* client, aerospace_model_callback callback, void* context)
+{
+	if (!client)
+		return false;
+
+	workspace_cache* cache = &client->workspaces;
+	bool fresh = model_fresh(client);
+	if (fresh && occupancy_fresh(cache)) {
+		client->stats.workspace_cache_hits++;
+		callback(context, &cache->model);
+		return true;
+	}
+
+	client->stats.workspace_cache_misses++;
+	if (fresh) {
+		if (!occupancy_in_flight(cache) && !start_occupancy_refresh(client))
+			return false;
+	} else if (!fetch_in_flight(cache) && !start_fetch(client)) {
+		return false;
+	}
+
+	if (cache->waiter_count >= MAX_LIST_WAITERS) {
+		log_error("Too many callers waiting for the workspace list\n");
+		return false;
+	}
+	cache->waiters[cache->waiter_count++] = (model_waiter) { callback, context };
+	return true;
+}
+
+// Focus moved to model.names[index]. Fetches sent before `after_id` predate
+// that and have their focused reply overridden.
+static void note_focus(workspace_cache* cache, int index, uint64_t after_id)
+{
+	cache->model.focused = index;
+	cache->local_focus_id = after_id;
+	strcpy(cache->local_focus, cache->model.names[index]);
+}
+
+void aerospace_set_focused_workspace(aerospace* client, int index)
+{
+	if (!client)
+		return;
+
+	workspace_cache* cache = &client->workspaces;
+	if (!cache->has_model || index < 0 || index >= cache->model.count)
+		return;
+
+	note_focus(cache, index, client->next_id);
+}
+
+void aerospace_invalidate_workspaces(aerospace* client)
+{
+	if (!client)
+		return;
+
+	workspace_cache* cache = &client->workspaces;
+	cache->has_model = false;
+	cache->fetched_at = 0;
+	cache->valid_after_id = client->next_id + 1;
+}
+
+static void close_subscription(void* context)
+{
+	subscription* sub = context;
+	errno = 0;
+	if (close(sub->fd) < 0) {
+		log_error("%s: %s (errno %d)\n", ERROR_SOCKET_CLOSE, strerror(errno), errno);
+	}
+	free(sub);
+}
+
+static void unsubscribe(aerospace* client, double retry_after)
+{
+	subscription* sub = client->sub;
+	if (!sub)
+		return;
+
+	dispatch_source_cancel(sub->read_source);
+	dispatch_release(sub->read_source);
+	client->sub = NULL;
+	client->stats.subscribed = false;
+	client->next_subscribe_at = monotonic_seconds() + retry_after;
+
+	// Events may have been missed
+	aerospace_invalidate_workspaces(client);
+}
+
+static void handle_event(aerospace* client, subscription* sub, yyjson_val* root)
+{
+	const char* event = yyjson_get_str(yyjson_obj_get(root, "_event"));
+	if (!event) {
+		// The answer to `subscribe` itself
+		yyjson_val* exit_code = yyjson_obj_get(root, "exitCode");
+		if (yyjson_is_int(exit_code) && yyjson_get_int(exit_code) != 0) {
+			const char* error = yyjson_get_str(yyjson_obj_get(root, "stderr"));
+			log_warn("AeroSpace rejected subscribe (%s), polling the workspace list instead\n",
+				error ? error : "no error message");
+			client->subscribe_unsupported = true;
+			unsubscribe(client, 0);
+			return;
+		}
+		sub->live = true;
+		client->stats.subscribed = true;
+		return;
+	}
+
+	sub->live = true;
+	client->stats.subscribed = true;
+	client->stats.workspace_events++;
+
+	workspace_cache* cache = &client->workspaces;
+	if (strcmp(event, "focused-workspace-changed") == 0 && cache->has_model) {
+		const char* ws = yyjson_get_str(yyjson_obj_get(root, "workspace"));
+		int index = ws ? workspace_model_find(&cache->model, ws, strlen(ws)) : -1;
+		if (index >= 0) {
+			note_focus(cache, index, client->next_id + 1);
+			return;
+		}
+	}
+
+	// Focus left the modelled monitor, or a window appeared somewhere:
+	// refetch on the next arm.
+	aerospace_invalidate_workspaces(client);
+}
+
+static void on_subscription_readable(void* context)
+{
+	subscription* sub = context;
+	aerospace* client = sub->client;
+	if (client->sub != sub)
+		return;
+
+	ssize_t bytes_read = read(sub->fd, sub->buf + sub->len, sizeof(sub->buf) - sub->len);
+	if (bytes_read < 0 && (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK))
+		return;
+	if (bytes_read <= 0) {
+		log_warn("AeroSpace event stream closed, resubscribing in %.0fs\n", SUBSCRIBE_RETRY_SECS);
+		unsubscribe(client, SUBSCRIBE_RETRY_SECS);
+		return;
+	}
+	sub->len += bytes_read;
+
+	while (client->sub == sub && sub->len > 0) {
+		size_t skip = 0;
+		while (skip < sub->len && isspace((unsigned char)sub->buf[skip]))
+			skip++;
+		if (skip) {
+			memmove(sub->buf, sub->buf + skip, sub->len - skip);
+			sub->len -= skip;
+			continue;
+		}
+
+		yyjson_alc alc;
+		yyjson_alc_pool_init(&alc, client->parse_pool, client->parse_pool_size);
+		yyjson_doc* doc = yyjson_read_opts(sub->buf, sub->len, YYJSON_READ_STOP_WHEN_DONE, &alc, NULL);
+		if (!doc) {
+			if (sub->len >= sizeof(sub->buf)) {
+				log_error("Error: Event buffer overflow, resubscribing.\n");
+				unsubscribe(client, 0);
+			}
+			return;
+		}
+
+		// The doc holds its own copy of the strings, and handling the event
+		// may drop the subscription, so consume the bytes first.
+		size_t parsed_bytes = yyjson_doc_get_read_size(doc);
+		memmove(sub->buf, sub->buf + parsed_bytes, sub->len - parsed_bytes);
+		sub->len -= parsed_bytes;
+
+		handle_event(client, sub, yyjson_doc_get_root(doc));
+		yyjson_doc_free(doc);
+	}
+}
+
+static void install_subscription(void* context);
+
+// Utility queue. Connects and sends `subscribe`, then hands the socket (or
+// -1) to the client queue. Reads only what is fixed once the client has
+// connected: socket_path and subscribe_request.
+static void open_subscription(void* context)
+{
+	aerospace* client = context;
+	int fd = connect_socket(client->socket_path);
+	if (fd >= 0) {
+		static const char suffix[] = "\"}\n";
+		struct iovec iov[2];
+		iov[0].iov_base = client->subscribe_request.prefix;
+		iov[0].iov_len = client->subscribe_request.prefix_len;
+		iov[1].iov_base = (void*)suffix;
+		iov[1].iov_len = sizeof(suffix) - 1;
+		if (!write_all(fd, iov, 2)) {
+			log_error("Failed to subscribe to AeroSpace events: %s (errno %d)\n", strerror(errno), errno);
+			close(fd);
+			fd = -1;
+		}
+	}
+
+	client->subscribe_fd = fd;
+	dispatch_async_f(client->queue, client, install_subscription);
+}
+
+// Opens the event stream if it is not running. Cheap to call on every
+// command, including on the commit path: the connect and write happen off
+// the client queue, failures back off for SUBSCRIBE_RETRY_SECS, and an
+// AeroSpace without `subscribe` is never asked again.
+static void subscribe(aerospace* client)
+{
+	if (client->sub || client->subscribing || client->subscribe_unsupported || client->closing
+		|| monotonic_seconds() < client->next_subscribe_at)
+		return;
+
+	client->next_subscribe_at = monotonic_seconds() + SUBSCRIBE_RETRY_SECS;
+	client->subscribing = true;
+	dispatch_group_async_f(client->subscribe_group, dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), client,
+		open_subscription);
+}
+
+static void install_subscription(void* context)
+{
+	aerospace* client = context;
+	int fd = client->subscribe_fd;
+	client->subscribing = false;
+	if (fd < 0)
+		return;
+	if (client->sub || client->closing) {
+		close(fd);
+		return;
+	}
+
+	subscription* sub = calloc(1, sizeof(subscription));
+	sub->client = client;
+	sub->fd = fd;
+	sub->read_source = dispatch_source_create(DISPATCH_SOURCE_TYPE_READ, fd, 0, client->queue);
+	dispatch_set_context(sub->read_source, sub);
+	dispatch_source_set_event_handler_f(sub->read_source, on_subscription_readable);
+	dispatch_source_set_cancel_handler_f(sub->read_source, close_subscription);
+	dispatch_resume(sub->read_source);
+	client->sub = sub;
+}
+
+typedef struct {
+	aerospace* client;
+	aerospace_stats* stats;
+} stats_request;
+
+static void copy_stats(void* context)
+{
+	stats_request* request = context;
+	*request->stats = request->client->stats;
+}
+
+void aerospace_get_stats(aerospace* client, aerospace_stats* stats)
+{
+	if (client && stats) {
+		stats_request request = { client, stats };
+		dispatch_sync_f(client->queue, &request, copy_stats);
+	}
+}
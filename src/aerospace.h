@@ -1,24 +1,121 @@
 #define AEROSPACE_H
 
+#include <dispatch/dispatch.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <sys/types.h>
 
-// Reconnect the socket every N commands to prevent staleness
-#define AEROSPACE_RECONNECT_INTERVAL 50
+#include "workspace_model.h"
+
+// How long a prefetched workspace model may be served without re-asking AeroSpace
+#define AEROSPACE_WORKSPACE_CACHE_TTL_SECS 1.0
+
+// Same, while AeroSpace's event stream keeps the model current. Occupancy
+// is not covered: AeroSpace sends no event when a window closes or moves,
+// so which workspaces are empty is re-asked after
+// AEROSPACE_WORKSPACE_CACHE_TTL_SECS either way, with a single command.
+#define AEROSPACE_SUBSCRIBED_CACHE_TTL_SECS 30.0
+
+// Commands that may be written to the socket before their responses arrive
+#define AEROSPACE_MAX_IN_FLIGHT 16
+
+// exit_code reported when the command never got a response (socket error,
+// timeout, disconnect)
+#define AEROSPACE_EXIT_TRANSPORT (-1)
+
+// Longest pre-serialized command (everything before the stdin payload)
+#define AEROSPACE_REQUEST_MAX 512
 
 typedef struct aerospace aerospace;
 
+// A command serialized once, up to the opening quote of its "stdin" value.
+// expected_output_field must outlive the request (normally a literal).
+typedef struct {
+	char prefix[AEROSPACE_REQUEST_MAX];
+	size_t prefix_len;
+	const char* expected_output_field;
+} aerospace_request;
+
+typedef struct {
+	unsigned long workspace_cache_hits;
+	unsigned long workspace_cache_misses;
+	unsigned long workspace_events; // received on the subscription socket
+	bool subscribed;
+	unsigned long max_in_flight;
+	unsigned long reconnects;
+	unsigned long reconnect_failures;
+	double last_connect_ms; // connect() of the most recent reconnect
+	double max_connect_ms;
+	double last_outage_ms; // connection lost -> restored, most recent
+} aerospace_stats;
+
+// Completion for an asynchronous command. `output` is the command's stderr
+// when exit_code != 0, otherwise the requested output field (or NULL). It is
+// only valid for the duration of the call.
+typedef void (*aerospace_callback)(void* context, uint64_t request_id, int exit_code, const char* output);
+
+// `model` is NULL if it could not be fetched, and only valid for the
+// duration of the call.
+typedef void (*aerospace_model_callback)(void* context, const workspace_model* model);
+
+// Does not block: the socket is connected on the client queue, ahead of
+// anything queued there by the caller.
 aerospace* aerospace_new(const char* socketPath);
 
-// Ensure the socket is connected. Reconnects if broken or stale.
-// Returns 1 if connected, 0 if not (will retry next call).
+// Serial queue that owns the socket. Every function below except
+// aerospace_new/aerospace_close/aerospace_get_stats must run on it, and all
+// callbacks are delivered on it.
+dispatch_queue_t aerospace_queue(aerospace* client);
+
+// Ensure the socket is connected. Dropped connections are restored in the
+// background; this only attempts a connect itself if that has not happened
+// yet. Returns 1 if connected, 0 if not (will retry next call).
 int aerospace_ensure_connected(aerospace* client);
 
+// Not callable from aerospace_queue().
 void aerospace_close(aerospace* client);
 
+// Serializes `args` into `req`. Returns false if they do not fit.
+bool aerospace_request_init(aerospace_request* req, const char** args, int arg_count, const char* expected_output_field);
+
+// Sends a pre-serialized command with `stdin_payload` spliced in. Performs no
+// heap allocation. Same contract as aerospace_command_async().
+uint64_t aerospace_send_async(aerospace* client, const aerospace_request* req, const char* stdin_payload,
+	aerospace_callback callback, void* context);
+
+// Writes a command without waiting for its response. Several commands can be
+// in flight at once; responses are matched to requests in order. Returns the
+// request id, or 0 (without calling back) if the command could not be sent.
+uint64_t aerospace_command_async(aerospace* client, const char** args, int arg_count, const char* stdin_payload,
+	const char* expected_output_field, aerospace_callback callback, void* context);
+
+uint64_t aerospace_workspace_async(aerospace* client, int wrap_around, const char* ws_command, const char* stdin_payload,
+	aerospace_callback callback, void* context);
+
+// Synchronous wrappers: block the client queue until the response arrives.
 char* aerospace_switch(aerospace* client, const char* direction);
 
 char* aerospace_workspace(aerospace* client, int wrap_around, const char* ws_command, const char* stdin_payload);
 
 char* aerospace_list_workspaces(aerospace* client, bool include_empty);
+
+// Start fetching the workspace model for aerospace_workspace_model_async().
+void aerospace_prefetch_workspaces(aerospace* client);
+
+// Delivers the focused monitor's workspace model: immediately from the
+// prefetched copy while it is younger than AEROSPACE_WORKSPACE_CACHE_TTL_SECS,
+// otherwise once the in-flight or a new fetch completes. Returns false
+// (without calling back) if no fetch could be started.
+bool aerospace_workspace_model_async(aerospace* client, aerospace_model_callback callback, void* context);
+
+// Moves the cached focus to model.names[index] right after the switch to it
+// was sent, so the next swipe steps from there without waiting for the
+// reply. Invalidate the cache if that switch then fails.
+void aerospace_set_focused_workspace(aerospace* client, int index);
+
+void aerospace_invalidate_workspaces(aerospace* client);
+
+// Copies the counters on the client queue, so it blocks behind whatever is
+// queued there and must not be called from it.
+void aerospace_get_stats(aerospace* client, aerospace_stats* stats);
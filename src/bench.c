@@ -0,0 +1,541 @@
+// Microbenchmarks for the per-frame gesture path and the AeroSpace client,
+// for checking hot-path changes against numbers instead of intuition.
+//
+//   bench [-l latency_us] [-t min_ms] [filter]
+//
+// Every benchmark is run with a growing iteration count until one run takes
+// at least min_ms (default 250), and that run is reported as ns/op and
+// heap allocations/op. The client benchmarks talk to a mock AeroSpace server
+// on a temporary Unix socket that answers every command after latency_us
+// (default 0). Only benchmarks whose name contains `filter` are run.
+#include <errno.h>
+#include <mach/mach.h>
+#include <malloc/malloc.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "aerospace.h"
+#include "gesture.h"
+#include "latency.h"
+#include "touch_kernel.h"
+#include "touch_table.h"
+#include "yyjson.h"
+
+#define BENCH_SWIPE_FRAMES 40 // moving frames per synthetic swipe, ~320ms at 125Hz
+#define BENCH_CYCLE_FRAMES (BENCH_SWIPE_FRAMES + 1) // ...plus the frame after lift-off
+#define BENCH_FRAME_SECS 0.008
+#define BENCH_BURST AEROSPACE_MAX_IN_FLIGHT
+
+static const int BENCH_TOUCHES[] = { 2, 4, 8, 16 };
+
+// Read buffer of the client; responses are parsed from one this size.
+#define BENCH_RESPONSE_MAX 8192
+
+// Every allocation made through the default malloc zone, from any thread.
+// Setup happens outside the measured runs, so whatever is counted during
+// one was made by the code under test (or, for the client benchmarks, by
+// libdispatch on its behalf).
+static _Atomic uint64_t g_allocations;
+static bool g_counting;
+
+static void* (*real_malloc)(malloc_zone_t*, size_t);
+static void* (*real_calloc)(malloc_zone_t*, size_t, size_t);
+static void* (*real_valloc)(malloc_zone_t*, size_t);
+static void* (*real_realloc)(malloc_zone_t*, void*, size_t);
+static void* (*real_memalign)(malloc_zone_t*, size_t, size_t);
+
+static void* counting_malloc(malloc_zone_t* zone, size_t size)
+{
+	atomic_fetch_add_explicit(&g_allocations, 1, memory_order_relaxed);
+	return real_malloc(zone, size);
+}
+
+static void* counting_calloc(malloc_zone_t* zone, size_t count, size_t size)
+{
+	atomic_fetch_add_explicit(&g_allocations, 1, memory_order_relaxed);
+	return real_calloc(zone, count, size);
+}
+
+static void* counting_valloc(malloc_zone_t* zone, size_t size)
+{
+	atomic_fetch_add_explicit(&g_allocations, 1, memory_order_relaxed);
+	return real_valloc(zone, size);
+}
+
+static void* counting_realloc(malloc_zone_t* zone, void* ptr, size_t size)
+{
+	atomic_fetch_add_explicit(&g_allocations, 1, memory_order_relaxed);
+	return real_realloc(zone, ptr, size);
+}
+
+static void* counting_memalign(malloc_zone_t* zone, size_t alignment, size_t size)
+{
+	atomic_fetch_add_explicit(&g_allocations, 1, memory_order_relaxed);
+	return real_memalign(zone, alignment, size);
+}
+
+// Swaps counting wrappers into the default zone, which is mapped read-only.
+// Without them allocations are reported as unknown.
+static void count_allocations(void)
+{
+	malloc_zone_t* zone = malloc_default_zone();
+	vm_address_t start = trunc_page((vm_address_t)zone);
+	vm_size_t size = round_page((vm_address_t)zone + sizeof(*zone)) - start;
+	if (vm_protect(mach_task_self(), start, size, 0, VM_PROT_READ | VM_PROT_WRITE) != KERN_SUCCESS) {
+		fprintf(stderr, "Could not hook the malloc zone, allocations will not be counted.\n");
+		return;
+	}
+
+	real_malloc = zone->malloc;
+	real_calloc = zone->calloc;
+	real_valloc = zone->valloc;
+	real_realloc = zone->realloc;
+	zone->malloc = counting_malloc;
+	zone->calloc = counting_calloc;
+	zone->valloc = counting_valloc;
+	zone->realloc = counting_realloc;
+	if (zone->version >= 5 && zone->memalign) {
+		real_memalign = zone->memalign;
+		zone->memalign = counting_memalign;
+	}
+
+	vm_protect(mach_task_self(), start, size, 0, VM_PROT_READ);
+	g_counting = true;
+}
+
+typedef struct {
+	const char* name;
+	void (*run)(void* context, uint64_t iterations);
+	void* context;
+} benchmark;
+
+static uint64_t g_min_ns = 250 * 1000000ULL;
+
+// Keeps results the compiler could otherwise prove unused.
+static volatile int g_sink;
+
+static void run_benchmark(const benchmark* bench)
+{
+	uint64_t iterations = 1;
+	for (;;) {
+		uint64_t allocations = atomic_load(&g_allocations);
+		uint64_t start = latency_now();
+		bench->run(bench->context, iterations);
+		uint64_t elapsed = latency_now() - start;
+		allocations = atomic_load(&g_allocations) - allocations;
+
+		if (elapsed >= g_min_ns || iterations >= (1ULL << 32)) {
+			printf("%-28s %12llu ops %12.1f ns/op", bench->name, (unsigned long long)iterations,
+				(double)elapsed / iterations);
+			if (g_counting)
+				printf(" %10.2f allocs/op\n", (double)allocations / iterations);
+			else
+				printf(" %10s allocs/op\n", "?");
+			return;
+		}
+
+		// Aim just past the target from this run's rate, growing at most 100x
+		// so a noisy first run cannot overshoot by much.
+		uint64_t next = elapsed ? iterations * g_min_ns / elapsed * 6 / 5 : iterations * 100;
+		if (next > iterations * 100)
+			next = iterations * 100;
+		iterations = next > iterations ? next : iterations + 1;
+	}
+}
+
+// A horizontal swipe with `touches` fingers, followed by an empty frame
+// after lift-off, at the rate a trackpad reports. Fingers beyond the five a
+// swipe can bind behave like resting contacts: the state machine sees them
+// every frame but never arms.
+static void make_swipe(touch_frame* frames, int touches)
+{
+	memset(frames, 0, sizeof(*frames) * BENCH_CYCLE_FRAMES);
+	for (int i = 0; i < BENCH_SWIPE_FRAMES; ++i) {
+		touch_frame* frame = &frames[i];
+		frame->count = touches;
+		frame->timestamp = i * BENCH_FRAME_SECS;
+		for (int k = 0; k < touches; ++k) {
+			frame->x[k] = 0.2f + i * 0.012f + k * 0.03f;
+			frame->y[k] = 0.3f + k * 0.02f;
+			frame->vx[k] = 1.2f;
+			frame->phase[k] = i == 0 ? 1 : (i == BENCH_SWIPE_FRAMES - 1 ? END_PHASE : 2);
+		}
+	}
+	frames[BENCH_SWIPE_FRAMES].timestamp = BENCH_SWIPE_FRAMES * BENCH_FRAME_SECS;
+}
+
+// Moves the cycle one swipe later, so timestamps keep increasing when the
+// frames are replayed.
+static void advance_swipe(touch_frame* frames)
+{
+	for (int i = 0; i < BENCH_CYCLE_FRAMES; ++i)
+		frames[i].timestamp += BENCH_CYCLE_FRAMES * BENCH_FRAME_SECS;
+}
+
+typedef struct {
+	touch_frame frames[BENCH_CYCLE_FRAMES];
+	Config config;
+	gesture_ctx gesture;
+	touch_table table;
+	touch_filter filter;
+} frame_bench;
+
+// One frame per op, the base being where the swipe started and prev the
+// frame before, as in the armed state.
+static void bench_summarize(void* context, uint64_t iterations)
+{
+	frame_bench* b = context;
+	const float* const base[2] = { b->frames[0].x, b->frames[0].y };
+	float travel[2] = { 0.05f, 0.04f };
+	float step[2] = { 0.001f, 0.002f };
+	int sink = 0;
+	for (uint64_t n = 0; n < iterations; ++n) {
+		int i = 1 + (int)(n % (BENCH_SWIPE_FRAMES - 1));
+		const float* const prev[2] = { b->frames[i - 1].x, b->frames[i - 1].y };
+		touch_summary sum;
+		touch_frame_summarize(&b->frames[i], base, prev, travel, step, &sum);
+		sink += sum.moved[TOUCH_AXIS_X][TOUCH_SLOW] + sum.stalled[TOUCH_AXIS_Y][TOUCH_FAST];
+	}
+	g_sink = sink;
+}
+
+static void on_bench_phase(__unused void* context, __unused double timestamp)
+{
+}
+
+static void on_bench_fire(void* context, __unused int fingers, __unused swipe_direction direction, int count,
+	__unused double timestamp)
+{
+	*(int*)context += count;
+}
+
+// One frame per op through the whole state machine: arming, committing and
+// the reset after lift-off all show up in proportion to a real swipe.
+static void bench_gesture(void* context, uint64_t iterations)
+{
+	frame_bench* b = context;
+	for (uint64_t n = 0; n < iterations; ++n) {
+		int i = (int)(n % BENCH_CYCLE_FRAMES);
+		gesture_process(&b->gesture, &b->frames[i]);
+		if (i == BENCH_CYCLE_FRAMES - 1)
+			advance_swipe(b->frames);
+	}
+}
+
+// The velocity state lookup and update the converter does for every touch
+// of a frame; touches lift on the last frame of each swipe and land with
+// new identities on the next.
+static void bench_touch_table(void* context, uint64_t iterations)
+{
+	frame_bench* b = context;
+	uint64_t identity = 0;
+	for (uint64_t n = 0; n < iterations; ++n) {
+		int i = (int)(n % BENCH_SWIPE_FRAMES);
+		const touch_frame* frame = &b->frames[i];
+		double timestamp = (double)n * BENCH_FRAME_SECS;
+		for (int k = 0; k < frame->count; ++k) {
+			bool created;
+			touch_state* state = touch_table_insert(&b->table, identity + k, &created);
+			touch_state_update(state, &b->filter, created, frame->x[k], frame->y[k], timestamp);
+			if (frame->phase[k] == END_PHASE)
+				touch_table_remove(&b->table, state);
+		}
+		if (i == BENCH_SWIPE_FRAMES - 1)
+			identity += MAX_TOUCHES;
+	}
+	g_sink = b->table.count;
+}
+
+typedef struct {
+	const char** args;
+	int arg_count;
+} encode_bench;
+
+static void bench_request_init(void* context, uint64_t iterations)
+{
+	encode_bench* b = context;
+	aerospace_request req;
+	size_t sink = 0;
+	for (uint64_t n = 0; n < iterations; ++n) {
+		aerospace_request_init(&req, b->args, b->arg_count, "stdout");
+		sink += req.prefix_len;
+	}
+	g_sink = (int)sink;
+}
+
+typedef struct {
+	const char* response;
+	size_t len;
+	void* pool;
+	size_t pool_size;
+} parse_bench;
+
+// The parse the client does for each response: a pool-backed read of one
+// document, then exitCode and the requested field.
+static void bench_parse(void* context, uint64_t iterations)
+{
+	parse_bench* b = context;
+	size_t sink = 0;
+	for (uint64_t n = 0; n < iterations; ++n) {
+		yyjson_alc alc;
+		yyjson_alc_pool_init(&alc, b->pool, b->pool_size);
+		yyjson_doc* doc = yyjson_read_opts((char*)b->response, b->len, YYJSON_READ_STOP_WHEN_DONE, &alc, NULL);
+		if (!doc)
+			continue;
+		yyjson_val* root = yyjson_doc_get_root(doc);
+		if (yyjson_get_int(yyjson_obj_get(root, "exitCode")) == 0)
+			sink += yyjson_get_len(yyjson_obj_get(root, "stdout"));
+		yyjson_doc_free(doc);
+	}
+	g_sink = (int)sink;
+}
+
+static const char MOCK_RESPONSE[] = "{\"exitCode\":0,\"stdout\":\"\",\"stderr\":\"\"}\n";
+
+static useconds_t g_latency_us;
+
+// Answers each newline-terminated command of one connection in order. The
+// subscription connection is answered once and then left idle.
+static void* mock_connection(void* context)
+{
+	int fd = (int)(intptr_t)context;
+	char buf[BENCH_RESPONSE_MAX];
+	size_t len = 0;
+	for (;;) {
+		ssize_t bytes_read = read(fd, buf + len, sizeof(buf) - len);
+		if (bytes_read < 0 && errno == EINTR)
+			continue;
+		if (bytes_read <= 0)
+			break;
+		len += bytes_read;
+
+		char* line = buf;
+		char* end;
+		while ((end = memchr(line, '\n', len - (line - buf)))) {
+			if (g_latency_us)
+				usleep(g_latency_us);
+			if (write(fd, MOCK_RESPONSE, sizeof(MOCK_RESPONSE) - 1) < 0)
+				goto done;
+			line = end + 1;
+		}
+		len -= line - buf;
+		memmove(buf, line, len);
+		if (len == sizeof(buf))
+			break;
+	}
+done:
+	close(fd);
+	return NULL;
+}
+
+static void* mock_accept(void* context)
+{
+	int listener = (int)(intptr_t)context;
+	for (;;) {
+		int fd = accept(listener, NULL, NULL);
+		if (fd < 0) {
+			if (errno == EINTR)
+				continue;
+			return NULL;
+		}
+		pthread_t thread;
+		if (pthread_create(&thread, NULL, mock_connection, (void*)(intptr_t)fd) == 0)
+			pthread_detach(thread);
+		else
+			close(fd);
+	}
+}
+
+static bool mock_start(const char* path)
+{
+	int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listener < 0)
+		return false;
+
+	struct sockaddr_un addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+	unlink(path);
+	if (bind(listener, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(listener, 4) < 0) {
+		close(listener);
+		return false;
+	}
+
+	pthread_t thread;
+	if (pthread_create(&thread, NULL, mock_accept, (void*)(intptr_t)listener) != 0) {
+		close(listener);
+		return false;
+	}
+	pthread_detach(thread);
+	return true;
+}
+
+typedef struct {
+	aerospace* client;
+	aerospace_request request;
+	dispatch_semaphore_t done;
+	int burst; // commands written before waiting for their responses
+	int sending; // ...in the current one, which may be cut short
+	int outstanding;
+	int failures;
+} client_bench;
+
+static void on_bench_reply(void* context, __unused uint64_t request_id, int exit_code, __unused const char* output)
+{
+	client_bench* b = context;
+	if (exit_code != 0)
+		b->failures++;
+	if (--b->outstanding == 0)
+		dispatch_semaphore_signal(b->done);
+}
+
+static void send_burst(void* context)
+{
+	client_bench* b = context;
+	b->outstanding = b->sending;
+	for (int i = 0; i < b->sending; ++i) {
+		if (!aerospace_send_async(b->client, &b->request, NULL, on_bench_reply, b)) {
+			b->failures++;
+			if (--b->outstanding == 0)
+				dispatch_semaphore_signal(b->done);
+		}
+	}
+}
+
+// Hand-off to the client queue, write, the server's reply, parse and the
+// callback: what a swipe waits for between deciding and the switch being
+// acknowledged. Ops are commands, so the burst variant shows pipelining.
+static void bench_round_trip(void* context, uint64_t iterations)
+{
+	client_bench* b = context;
+	for (uint64_t n = 0; n < iterations; n += b->sending) {
+		b->sending = iterations - n < (uint64_t)b->burst ? (int)(iterations - n) : b->burst;
+		dispatch_async_f(aerospace_queue(b->client), b, send_burst);
+		dispatch_semaphore_wait(b->done, DISPATCH_TIME_FOREVER);
+	}
+}
+
+static void ensure_connected(void* context)
+{
+	client_bench* b = context;
+	if (!aerospace_ensure_connected(b->client))
+		b->failures++;
+}
+
+static void usage(const char* argv0)
+{
+	fprintf(stderr, "usage: %s [-l latency_us] [-t min_ms] [filter]\n", argv0);
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char* argv[])
+{
+	int opt;
+	while ((opt = getopt(argc, argv, "l:t:")) != -1) {
+		switch (opt) {
+			case 'l':
+				g_latency_us = (useconds_t)atoi(optarg);
+				break;
+			case 't':
+				g_min_ns = (uint64_t)atoi(optarg) * 1000000ULL;
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+	if (optind < argc - 1)
+		usage(argv[0]);
+	const char* filter = optind < argc ? argv[optind] : NULL;
+
+	enum { FRAME_BENCHES = sizeof(BENCH_TOUCHES) / sizeof(BENCH_TOUCHES[0]) };
+	static benchmark benches[4 * FRAME_BENCHES + 8];
+	int bench_count = 0;
+
+	// Built-in defaults with the finger count of each synthetic swipe, so
+	// the swipes that can bind do commit.
+	static frame_bench frames[FRAME_BENCHES];
+	static int fired;
+	gesture_hooks hooks = { on_bench_phase, on_bench_phase, on_bench_fire, &fired };
+	for (int i = 0; i < FRAME_BENCHES; ++i) {
+		frame_bench* b = &frames[i];
+		make_swipe(b->frames, BENCH_TOUCHES[i]);
+		b->config = default_config();
+		if (BENCH_TOUCHES[i] < BINDING_FINGERS)
+			b->config.fingers = BENCH_TOUCHES[i];
+		b->filter = (touch_filter) { b->config.velocity_min_cutoff, b->config.velocity_beta };
+		gesture_init(&b->gesture, &b->config, &hooks);
+	}
+
+	static char names[3 * FRAME_BENCHES][32];
+	const char* kinds[] = { "touch_frame_summarize", "gesture_process", "touch_table" };
+	void (*runs[])(void*, uint64_t) = { bench_summarize, bench_gesture, bench_touch_table };
+	for (int kind = 0; kind < 3; ++kind) {
+		for (int i = 0; i < FRAME_BENCHES; ++i) {
+			char* name = names[kind * FRAME_BENCHES + i];
+			snprintf(name, sizeof(names[0]), "%s/%d", kinds[kind], BENCH_TOUCHES[i]);
+			benches[bench_count++] = (benchmark) { name, runs[kind], &frames[i] };
+		}
+	}
+
+	const char* workspace_args[] = { "workspace", "--wrap-around", "next" };
+	const char* command_args[] = { "move-node-to-workspace", "--focus-follows-window", "\"quoted\" name\twith\\escapes" };
+	encode_bench encode_short = { workspace_args, 3 };
+	encode_bench encode_escaped = { command_args, 3 };
+	benches[bench_count++] = (benchmark) { "request_init/workspace", bench_request_init, &encode_short };
+	benches[bench_count++] = (benchmark) { "request_init/escaped", bench_request_init, &encode_escaped };
+
+	static const char ack[] = "{\"exitCode\":0,\"stdout\":\"\",\"stderr\":\"\"}\n";
+	static const char listing[] = "{\"exitCode\":0,\"stdout\":\"1\\n2\\n3\\n4\\n5\\n6\\n7\\n8\\n9\\nA\\nB\\nC\\n\",\"stderr\":\"\"}\n";
+	size_t pool_size = yyjson_read_max_memory_usage(BENCH_RESPONSE_MAX, YYJSON_READ_STOP_WHEN_DONE);
+	static parse_bench parse_ack, parse_listing;
+	parse_ack = (parse_bench) { ack, sizeof(ack) - 1, malloc(pool_size), pool_size };
+	parse_listing = (parse_bench) { listing, sizeof(listing) - 1, malloc(pool_size), pool_size };
+	benches[bench_count++] = (benchmark) { "parse_response/ack", bench_parse, &parse_ack };
+	benches[bench_count++] = (benchmark) { "parse_response/listing", bench_parse, &parse_listing };
+
+	char socket_path[64];
+	snprintf(socket_path, sizeof(socket_path), "/tmp/swipe-bench-%d.sock", getpid());
+	static client_bench single, burst;
+	bool mock = false;
+	if (!filter || strstr("round_trip/single", filter) || strstr("round_trip/burst", filter)) {
+		mock = mock_start(socket_path);
+		if (!mock)
+			fprintf(stderr, "Could not start the mock server at %s: %s\n", socket_path, strerror(errno));
+	}
+	if (mock) {
+		aerospace* client = aerospace_new(socket_path);
+		single = (client_bench) { .client = client, .done = dispatch_semaphore_create(0), .burst = 1 };
+		aerospace_request_init(&single.request, workspace_args, 3, NULL);
+		burst = single;
+		burst.done = dispatch_semaphore_create(0);
+		burst.burst = BENCH_BURST;
+		dispatch_sync_f(aerospace_queue(client), &single, ensure_connected);
+		if (single.failures)
+			fprintf(stderr, "Could not connect to the mock server.\n");
+		else {
+			benches[bench_count++] = (benchmark) { "round_trip/single", bench_round_trip, &single };
+			benches[bench_count++] = (benchmark) { "round_trip/burst", bench_round_trip, &burst };
+		}
+	}
+
+	count_allocations();
+	printf("min time %llums, mock server latency %uus\n", (unsigned long long)(g_min_ns / 1000000ULL),
+		(unsigned)g_latency_us);
+	for (int i = 0; i < bench_count; ++i) {
+		if (!filter || strstr(benches[i].name, filter))
+			run_benchmark(&benches[i]);
+	}
+
+	if (single.failures || burst.failures)
+		fprintf(stderr, "%d commands failed.\n", single.failures + burst.failures);
+	if (mock)
+		unlink(socket_path);
+	return single.failures || burst.failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
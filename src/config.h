@@ -1,20 +1,59 @@
 #include <CoreFoundation/CoreFoundation.h>
 #define CONFIG_H
 
+#include "log.h"
 #include "yyjson.h"
 #include <pwd.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
+typedef enum {
+	INPUT_BACKEND_EVENT_TAP, // CGEventTap + NSTouch conversion
+	INPUT_BACKEND_MULTITOUCH // MultitouchSupport contact-frame callbacks
+} input_backend;
+
+// Largest finger count a binding can use, plus one
+#define BINDING_FINGERS 6
+#define BINDING_MAX 16
+#define BINDING_ARGS_MAX 8
+#define BINDING_ARG_LEN 64
+
+// Direction the fingers travel. Bit (direction >> 1) of binding_axes is its
+// axis: 0 horizontal, 1 vertical.
+typedef enum {
+	SWIPE_LEFT,
+	SWIPE_RIGHT,
+	SWIPE_DOWN,
+	SWIPE_UP,
+	SWIPE_DIRECTIONS
+} swipe_direction;
+
+// One entry of the "bindings" array: an AeroSpace command for a finger
+// count and direction, split into arguments.
+typedef struct {
+	int fingers;
+	swipe_direction direction;
+	int arg_count;
+	char args[BINDING_ARGS_MAX][BINDING_ARG_LEN];
+} binding_config;
+
 typedef struct {
 	bool natural_swipe;
 	bool wrap_around;
 	bool haptic;
 	bool skip_empty;
 	bool show_menu_bar;
+	bool coalesce_frames; // skip stale frames when the consumer falls behind
+	bool fling; // fast or long swipes jump several workspaces
+	bool scrub; // keep stepping while the fingers stay down
+	bool predictive_commit; // fire once the projected travel crosses distance_pct
+	bool tap_thread; // run the event tap on its own input thread
+	input_backend input_backend;
+	log_level log_level;
 	int fingers;
 	int swipe_tolerance;
 	int sensitivity;      // 1-5 scale, affects distance_pct and velocity_pct
@@ -30,13 +69,50 @@ typedef struct {
 	float palm_velocity;
 	float fast_distance_factor;   // For fast swipes, trigger at this fraction of distance_pct
 	float fast_velocity_threshold; // Minimum velocity to qualify as "fast"
+	float fling_velocity; // Peak velocity per extra workspace in a fling
+	float predict_horizon; // Seconds ahead the motion fit is projected
+	float predict_min_r2; // Fit quality required to trust the projection
+	double velocity_min_cutoff; // Velocity filter cutoff at rest (Hz)
+	double velocity_beta; // Cutoff gained per pad size per second
+	int fling_max_steps;
 	const char* swipe_left;
 	const char* swipe_right;
+	binding_config bindings[BINDING_MAX];
+	int binding_count;
+	uint8_t binding_axes[BINDING_FINGERS]; // by finger count: bit 0 horizontal, bit 1 vertical
 } Config;
 
+// Axes bound for `fingers`, including the built-in horizontal workspace
+// swipe for config->fingers.
+static inline int config_swipe_axes(const Config* config, int fingers)
+{
+	if (fingers <= 0 || fingers >= BINDING_FINGERS)
+		return 0;
+	return config->binding_axes[fingers] | (fingers == config->fingers ? 1 : 0);
+}
+
+// Fewest and most fingers any swipe uses.
+static inline int config_min_fingers(const Config* config)
+{
+	for (int fingers = 1; fingers < BINDING_FINGERS; ++fingers) {
+		if (config_swipe_axes(config, fingers))
+			return fingers;
+	}
+	return config->fingers;
+}
+
+static inline int config_max_fingers(const Config* config)
+{
+	for (int fingers = BINDING_FINGERS - 1; fingers > 0; --fingers) {
+		if (config_swipe_axes(config, fingers))
+			return fingers;
+	}
+	return config->fingers;
+}
+
 // Apply sensitivity level: 1=Low, 2=Medium, 3=High
 // All levels support early triggering on fast intentional swipes (60% of threshold)
-static void apply_sensitivity(Config* config, int level)
+static inline void apply_sensitivity(Config* config, int level)
 {
 	config->sensitivity = level;
 
@@ -67,7 +143,7 @@ static void apply_sensitivity(Config* config, int level)
 	}
 }
 
-static Config default_config()
+static inline Config default_config()
 {
 	Config config;
 	config.natural_swipe = false;
@@ -75,6 +151,13 @@ static Config default_config()
 	config.haptic = false;
 	config.skip_empty = true;
 	config.show_menu_bar = true;
+	config.coalesce_frames = true;
+	config.fling = false;
+	config.scrub = false;
+	config.predictive_commit = false;
+	config.tap_thread = false;
+	config.input_backend = INPUT_BACKEND_EVENT_TAP;
+	config.log_level = LOG_LEVEL_INFO;
 	config.fingers = 3;
 	config.swipe_tolerance = 2;      // Allow up to 2 fingers to mismatch
 	config.sensitivity = 2;          // Default sensitivity level (1=Low, 2=Medium, 3=High)
@@ -87,15 +170,96 @@ static Config default_config()
 	config.palm_velocity = 0.1;      // 10% of pad dimension per second
 	config.fast_distance_factor = 0.60f;   // Fast swipes can trigger at 60% of normal distance
 	config.fast_velocity_threshold = 0.35f; // Velocity needed for fast-trigger
+	config.fling_velocity = 1.5f;    // 1.5 pads/s per extra workspace
+	config.fling_max_steps = 5;
+	config.predict_horizon = 0.05f;  // 50ms ahead
+	config.predict_min_r2 = 0.90f;
+	config.velocity_min_cutoff = 5.0;
+	config.velocity_beta = 10.0;
 	config.swipe_left = "prev";
 	config.swipe_right = "next";
+	config.binding_count = 0;
+	memset(config.binding_axes, 0, sizeof(config.binding_axes));
 
 	// Apply default sensitivity
 	apply_sensitivity(&config, config.sensitivity);
 	return config;
 }
 
-static int read_file_to_buffer(const char* path, char** out, size_t* size)
+static const char* const SWIPE_DIRECTION_NAMES[SWIPE_DIRECTIONS] = { "left", "right", "down", "up" };
+
+static inline bool parse_swipe_direction(const char* name, swipe_direction* direction)
+{
+	for (int i = 0; i < SWIPE_DIRECTIONS; ++i) {
+		if (strcmp(name, SWIPE_DIRECTION_NAMES[i]) == 0) {
+			*direction = (swipe_direction)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+// Splits an AeroSpace command line on whitespace into binding->args.
+static inline bool parse_binding_command(const char* command, binding_config* binding)
+{
+	binding->arg_count = 0;
+	for (const char* p = command; *p;) {
+		while (*p == ' ' || *p == '\t')
+			p++;
+		if (!*p)
+			break;
+
+		size_t len = strcspn(p, " \t");
+		if (binding->arg_count >= BINDING_ARGS_MAX || len >= BINDING_ARG_LEN)
+			return false;
+		memcpy(binding->args[binding->arg_count], p, len);
+		binding->args[binding->arg_count][len] = '\0';
+		binding->arg_count++;
+		p += len;
+	}
+	return binding->arg_count > 0;
+}
+
+// "bindings": [{ "fingers": 4, "direction": "left", "command": "move-node-to-workspace prev" }, ...]
+static inline void parse_bindings(yyjson_val* array, Config* config)
+{
+	size_t index, max;
+	yyjson_val* entry;
+	yyjson_arr_foreach(array, index, max, entry)
+	{
+		yyjson_val* fingers = yyjson_obj_get(entry, "fingers");
+		yyjson_val* direction = yyjson_obj_get(entry, "direction");
+		yyjson_val* command = yyjson_obj_get(entry, "command");
+		if (!yyjson_is_int(fingers) || !yyjson_is_str(direction) || !yyjson_is_str(command)) {
+			fprintf(stderr, "Ignoring binding %zu: needs fingers, direction and command.\n", index);
+			continue;
+		}
+		if (config->binding_count >= BINDING_MAX) {
+			fprintf(stderr, "Ignoring bindings past the first %d.\n", BINDING_MAX);
+			break;
+		}
+
+		binding_config* binding = &config->bindings[config->binding_count];
+		binding->fingers = (int)yyjson_get_int(fingers);
+		if (binding->fingers < 2 || binding->fingers >= BINDING_FINGERS) {
+			fprintf(stderr, "Ignoring binding %zu: fingers must be 2-%d.\n", index, BINDING_FINGERS - 1);
+			continue;
+		}
+		if (!parse_swipe_direction(yyjson_get_str(direction), &binding->direction)) {
+			fprintf(stderr, "Ignoring binding %zu: unknown direction '%s'.\n", index, yyjson_get_str(direction));
+			continue;
+		}
+		if (!parse_binding_command(yyjson_get_str(command), binding)) {
+			fprintf(stderr, "Ignoring binding %zu: command is empty or too long.\n", index);
+			continue;
+		}
+
+		config->binding_axes[binding->fingers] |= 1 << (binding->direction >> 1);
+		config->binding_count++;
+	}
+}
+
+static inline int read_file_to_buffer(const char* path, char** out, size_t* size)
 {
 	FILE* file = fopen(path, "rb");
 	if (!file)
@@ -120,41 +284,39 @@ static int read_file_to_buffer(const char* path, char** out, size_t* size)
 	return 1;
 }
 
-static Config load_config()
+// The config file to use: ./config.json if it exists, otherwise
+// ~/.config/aerospace-swipe/config.json. Returns false if neither exists,
+// with `out` set to the latter.
+static inline bool config_find_path(char* out, size_t size)
 {
-	Config config = default_config();
-
-	char* buffer = NULL;
-	size_t buffer_size = 0;
-	const char* paths[] = { "./config.json", NULL };
-
-	char fallback_path[512];
-	struct passwd* pw = getpwuid(getuid());
-	if (pw) {
-		snprintf(fallback_path, sizeof(fallback_path),
-			"%s/.config/aerospace-swipe/config.json", pw->pw_dir);
-		paths[1] = fallback_path;
+	struct stat st;
+	if (stat("./config.json", &st) == 0) {
+		snprintf(out, size, "./config.json");
+		return true;
 	}
 
-	for (int i = 0; i < 2; ++i) {
-		if (paths[i] && read_file_to_buffer(paths[i], &buffer, &buffer_size)) {
-			printf("Loaded config from: %s\n", paths[i]);
-			break;
-		}
-	}
+	struct passwd* pw = getpwuid(getuid());
+	snprintf(out, size, "%s/.config/aerospace-swipe/config.json", pw ? pw->pw_dir : ".");
+	return stat(out, &st) == 0;
+}
 
-	if (!buffer) {
-		fprintf(stderr, "Using default configuration.\n");
-		return config;
-	}
+// Parses the file at `path` over the defaults. Returns false, leaving
+// `out` untouched, if it cannot be read or is not valid JSON.
+static inline bool config_read_file(const char* path, Config* out)
+{
+	char* buffer = NULL;
+	size_t buffer_size = 0;
+	if (!read_file_to_buffer(path, &buffer, &buffer_size))
+		return false;
 
 	yyjson_doc* doc = yyjson_read(buffer, buffer_size, 0);
 	free(buffer);
 	if (!doc) {
-		fprintf(stderr, "Failed to parse config JSON. Using defaults.\n");
-		return config;
+		fprintf(stderr, "Failed to parse config JSON in %s.\n", path);
+		return false;
 	}
 
+	Config config = default_config();
 	yyjson_val* root = yyjson_doc_get_root(doc);
 	yyjson_val* item;
 
@@ -182,8 +344,9 @@ static Config load_config()
 	if (item && yyjson_is_int(item))
 		config.swipe_tolerance = (int)yyjson_get_int(item);
 
+	// fling and scrub divide by it
 	item = yyjson_obj_get(root, "distance_pct");
-	if (item && yyjson_is_real(item))
+	if (item && yyjson_is_real(item) && yyjson_get_real(item) > 0)
 		config.distance_pct = (float)yyjson_get_real(item);
 
 	item = yyjson_obj_get(root, "velocity_pct");
@@ -194,10 +357,96 @@ static Config load_config()
 	if (item && yyjson_is_real(item))
 		config.settle_factor = (float)yyjson_get_real(item);
 
+	item = yyjson_obj_get(root, "velocity_min_cutoff");
+	if (item && yyjson_is_real(item) && yyjson_get_real(item) > 0)
+		config.velocity_min_cutoff = yyjson_get_real(item);
+
+	item = yyjson_obj_get(root, "velocity_beta");
+	if (item && yyjson_is_real(item) && yyjson_get_real(item) >= 0)
+		config.velocity_beta = yyjson_get_real(item);
+
+	item = yyjson_obj_get(root, "palm_disp");
+	if (item && yyjson_is_real(item))
+		config.palm_disp = (float)yyjson_get_real(item);
+
+	item = yyjson_obj_get(root, "palm_age");
+	if (item && yyjson_is_real(item))
+		config.palm_age = yyjson_get_real(item);
+
+	item = yyjson_obj_get(root, "palm_velocity");
+	if (item && yyjson_is_real(item))
+		config.palm_velocity = (float)yyjson_get_real(item);
+
 	item = yyjson_obj_get(root, "show_menu_bar");
 	if (item && yyjson_is_bool(item))
 		config.show_menu_bar = yyjson_get_bool(item);
 
+	item = yyjson_obj_get(root, "coalesce_frames");
+	if (item && yyjson_is_bool(item))
+		config.coalesce_frames = yyjson_get_bool(item);
+
+	item = yyjson_obj_get(root, "fling");
+	if (item && yyjson_is_bool(item))
+		config.fling = yyjson_get_bool(item);
+
+	item = yyjson_obj_get(root, "scrub");
+	if (item && yyjson_is_bool(item))
+		config.scrub = yyjson_get_bool(item);
+
+	item = yyjson_obj_get(root, "predictive_commit");
+	if (item && yyjson_is_bool(item))
+		config.predictive_commit = yyjson_get_bool(item);
+
+	item = yyjson_obj_get(root, "predict_horizon");
+	if (item && yyjson_is_real(item) && yyjson_get_real(item) >= 0)
+		config.predict_horizon = (float)yyjson_get_real(item);
+
+	item = yyjson_obj_get(root, "predict_min_r2");
+	if (item && yyjson_is_real(item))
+		config.predict_min_r2 = (float)yyjson_get_real(item);
+
+	item = yyjson_obj_get(root, "fling_velocity");
+	if (item && yyjson_is_real(item) && yyjson_get_real(item) > 0)
+		config.fling_velocity = (float)yyjson_get_real(item);
+
+	item = yyjson_obj_get(root, "fling_max_steps");
+	if (item && yyjson_is_int(item) && yyjson_get_int(item) >= 1)
+		config.fling_max_steps = (int)yyjson_get_int(item);
+
+	item = yyjson_obj_get(root, "tap_thread");
+	if (item && yyjson_is_bool(item))
+		config.tap_thread = yyjson_get_bool(item);
+
+	item = yyjson_obj_get(root, "input_backend");
+	if (item && yyjson_is_str(item)) {
+		const char* backend = yyjson_get_str(item);
+		if (strcmp(backend, "multitouch") == 0)
+			config.input_backend = INPUT_BACKEND_MULTITOUCH;
+		else if (strcmp(backend, "event_tap") == 0)
+			config.input_backend = INPUT_BACKEND_EVENT_TAP;
+		else
+			fprintf(stderr, "Unknown input_backend '%s', using event_tap.\n", backend);
+	}
+
+	item = yyjson_obj_get(root, "log_level");
+	if (item && yyjson_is_str(item)) {
+		const char* level = yyjson_get_str(item);
+		if (strcmp(level, "error") == 0)
+			config.log_level = LOG_LEVEL_ERROR;
+		else if (strcmp(level, "warn") == 0)
+			config.log_level = LOG_LEVEL_WARN;
+		else if (strcmp(level, "info") == 0)
+			config.log_level = LOG_LEVEL_INFO;
+		else if (strcmp(level, "debug") == 0)
+			config.log_level = LOG_LEVEL_DEBUG;
+		else
+			fprintf(stderr, "Unknown log_level '%s', using info.\n", level);
+	}
+
+	item = yyjson_obj_get(root, "bindings");
+	if (item && yyjson_is_arr(item))
+		parse_bindings(item, &config);
+
 	// Sensitivity can be set via JSON (1-5), overrides distance/velocity
 	item = yyjson_obj_get(root, "sensitivity");
 	if (item && yyjson_is_int(item)) {
@@ -208,5 +457,27 @@ static Config load_config()
 	config.swipe_right = config.natural_swipe ? "prev" : "next";
 
 	yyjson_doc_free(doc);
+	*out = config;
+	return true;
+}
+
+// Loads `path`, or with NULL the file config_find_path() picks. Falls back
+// to the defaults if that fails.
+static inline Config load_config_from(const char* path)
+{
+	char found[512];
+	if (!path && config_find_path(found, sizeof(found)))
+		path = found;
+
+	Config config = default_config();
+	if (path && config_read_file(path, &config))
+		printf("Loaded config from: %s\n", path);
+	else
+		fprintf(stderr, "Using default configuration.\n");
 	return config;
 }
+
+static inline Config load_config()
+{
+	return load_config_from(NULL);
+}
@@ -0,0 +1,102 @@
+#include <dispatch/dispatch.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "config_watch.h"
+#include "log.h"
+
+// Editors save in several steps (truncate, write, chmod); one reload
+// covers them all.
+#define CONFIG_WATCH_SETTLE_MS 100
+// How often a missing file is looked for
+#define CONFIG_WATCH_RETRY_SECS 2
+
+#define CONFIG_WATCH_EVENTS (DISPATCH_VNODE_WRITE | DISPATCH_VNODE_EXTEND | DISPATCH_VNODE_ATTRIB \
+	| DISPATCH_VNODE_DELETE | DISPATCH_VNODE_RENAME | DISPATCH_VNODE_REVOKE)
+
+static char g_path[1024];
+static void (*g_changed)(void* context);
+static void* g_context;
+static dispatch_queue_t g_queue;
+static dispatch_source_t g_source; // watch queue only
+static bool g_pending; // watch queue only, a notify is scheduled
+
+static void watch(void* context);
+
+static void notify(__unused void* context)
+{
+	g_pending = false;
+	g_changed(g_context);
+}
+
+static void schedule_notify(void)
+{
+	if (g_pending)
+		return;
+	g_pending = true;
+	dispatch_after_f(dispatch_time(DISPATCH_TIME_NOW, CONFIG_WATCH_SETTLE_MS * NSEC_PER_MSEC), g_queue, NULL, notify);
+}
+
+static void on_event(__unused void* context)
+{
+	unsigned long flags = dispatch_source_get_data(g_source);
+	if (flags & (DISPATCH_VNODE_DELETE | DISPATCH_VNODE_RENAME | DISPATCH_VNODE_REVOKE)) {
+		// The path now names another file, or none yet; watch that instead
+		dispatch_source_cancel(g_source);
+		g_source = NULL;
+		watch(NULL);
+		if (!g_source)
+			return; // notified once the file is back
+	}
+	schedule_notify();
+}
+
+static void on_cancel(void* context)
+{
+	close((int)(intptr_t)context);
+}
+
+// Watch queue. `context` is non-NULL when retrying for a missing file,
+// which counts as a change once it appears.
+static void watch(void* context)
+{
+	int fd = open(g_path, O_EVTONLY);
+	if (fd < 0) {
+		dispatch_after_f(dispatch_time(DISPATCH_TIME_NOW, CONFIG_WATCH_RETRY_SECS * NSEC_PER_SEC), g_queue,
+			(void*)1, watch);
+		return;
+	}
+
+	g_source = dispatch_source_create(DISPATCH_SOURCE_TYPE_VNODE, (uintptr_t)fd, CONFIG_WATCH_EVENTS, g_queue);
+	if (!g_source) {
+		log_error("Error: Could not watch %s for changes.\n", g_path);
+		close(fd);
+		return;
+	}
+	dispatch_set_context(g_source, (void*)(intptr_t)fd);
+	dispatch_source_set_event_handler_f(g_source, on_event);
+	dispatch_source_set_cancel_handler_f(g_source, on_cancel);
+	dispatch_resume(g_source);
+
+	if (context)
+		schedule_notify();
+}
+
+bool config_watch_start(const char* path, void (*changed)(void* context), void* context)
+{
+	if (g_queue || strlen(path) >= sizeof(g_path))
+		return false;
+
+	snprintf(g_path, sizeof(g_path), "%s", path);
+	g_changed = changed;
+	g_context = context;
+
+	dispatch_queue_attr_t attr = dispatch_queue_attr_make_with_qos_class(
+		DISPATCH_QUEUE_SERIAL, QOS_CLASS_UTILITY, 0);
+	g_queue = dispatch_queue_create("com.acsandmann.swipe.config", attr);
+	dispatch_async_f(g_queue, NULL, watch);
+	return true;
+}
@@ -0,0 +1,8 @@
+#pragma once
+#include <stdbool.h>
+
+// Calls `changed` on a background queue shortly after the file at `path` is
+// written, replaced (editors that save by renaming a new file over it) or
+// created. A missing file is polled for until it appears. One watch per
+// process; returns false if one is already running.
+bool config_watch_start(const char* path, void (*changed)(void* context), void* context);
@@ -3,13 +3,11 @@
 #import <CoreGraphics/CoreGraphics.h>
 #import <Foundation/Foundation.h>
 #include <objc/message.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
 
-#define ACTIVATE_PCT 0.05f
-#define END_PHASE 8 // NSTouchPhaseEnded
-#define FAST_VEL_FACTOR 0.80f
-#define MAX_TOUCHES 16
+#include "touch.h"
 
 extern const char* get_name_for_pid(uint64_t pid);
 extern char* string_copy(char* s);
@@ -18,43 +16,17 @@ struct event_tap {
 	CFMachPortRef handle;
 	CFRunLoopSourceRef runloop_source;
 	CGEventMask mask;
+	CFRunLoopRef runloop; // the one runloop_source was added to
+	pthread_t thread; // with event_tap_begin_on_thread()
+	bool threaded;
 };
 
-typedef struct {
-	double x;
-	double y;
-	int phase;
-	double timestamp;
-	double velocity;
-	bool is_palm;
-} touch;
-
-typedef struct {
-	double x;
-	double y;
-	double timestamp;
-} touch_state;
-
-// Gesture state enumeration
-typedef enum {
-	GS_IDLE,
-	GS_ARMED,
-	GS_COMMITTED
-} gesture_state;
-
-// Gesture context structure
-typedef struct {
-	gesture_state state;
-	float start_x, start_y, peak_velx;
-	int dir, last_fire_dir;
-	float prev_x[MAX_TOUCHES], base_x[MAX_TOUCHES];
-} gesture_ctx;
-
 // Palm rejection tracking structure
 typedef struct {
+	uint64_t identity;
 	CGPoint start, last;
 	CFTimeInterval t_start, t_last;
-	CGFloat travel;
+	CGFloat travel, speed;
 	bool is_palm, seen;
 } finger_track;
 
@@ -62,9 +34,16 @@ typedef struct {
 + (touch)convert_nstouch:(id)nsTouch;
 @end
 
+// Velocity smoothing for convert_nstouch. Safe to call while the event tap
+// runs: the input thread picks it up from the next touch.
+void touch_converter_set_filter(double min_cutoff, double beta);
+
 extern struct event_tap g_event_tap;
-static CFMutableDictionaryRef touchStates;
 
 bool event_tap_enabled(struct event_tap* event_tap);
 bool event_tap_begin(struct event_tap* event_tap, CGEventRef (*reference)(CGEventTapProxy proxy, CGEventType type, CGEventRef event, void* userdata));
+// Same, but the tap runs on its own user-interactive thread and run loop, so
+// a busy main thread (menus, AppKit) cannot delay input. The callback must
+// then bring its own autorelease pool.
+bool event_tap_begin_on_thread(struct event_tap* event_tap, CGEventRef (*reference)(CGEventTapProxy proxy, CGEventType type, CGEventRef event, void* userdata));
 void event_tap_end(struct event_tap* event_tap);
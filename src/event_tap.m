@@ -1,13 +1,74 @@
 #import "event_tap.h"
+#include "log.h"
+#include "touch_table.h"
 #import <AppKit/AppKit.h>
 #include <CoreFoundation/CoreFoundation.h>
 #include <objc/message.h>
 #include <objc/runtime.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 struct event_tap g_event_tap = { 0 };
 
+_Static_assert(TOUCH_TABLE_SLOTS >= 2 * MAX_TOUCHES, "touch table too small for MAX_TOUCHES");
+
+// Only touched from the event tap thread.
+static touch_table g_touch_table = { 0 };
+
+static const touch_filter DEFAULT_TOUCH_FILTER = { 5.0, 10.0 };
+// Both parameters as floats, so they are read in one atomic load. 0 until
+// set: min_cutoff is never 0.
+static _Atomic uint64_t g_touch_filter = 0;
+
+void touch_converter_set_filter(double min_cutoff, double beta)
+{
+	float packed[2] = { (float)min_cutoff, (float)beta };
+	uint64_t bits;
+	memcpy(&bits, packed, sizeof(bits));
+	atomic_store_explicit(&g_touch_filter, bits, memory_order_relaxed);
+}
+
+static touch_filter current_touch_filter(void)
+{
+	uint64_t bits = atomic_load_explicit(&g_touch_filter, memory_order_relaxed);
+	if (!bits)
+		return DEFAULT_TOUCH_FILTER;
+
+	float packed[2];
+	memcpy(packed, &bits, sizeof(packed));
+	return (touch_filter) { packed[0], packed[1] };
+}
+
+// -[NSTouch timestamp] is private; resolve its IMP once per class instead
+// of going through KVC and an NSNumber for every touch.
+typedef double (*touch_timestamp_imp)(id, SEL);
+static Class g_timestamp_class = Nil;
+static touch_timestamp_imp g_timestamp_imp = NULL;
+
+static double touch_timestamp(NSTouch* touchObj)
+{
+	SEL sel = @selector(timestamp);
+	Class cls = object_getClass(touchObj);
+	if (cls != g_timestamp_class) {
+		g_timestamp_class = cls;
+		g_timestamp_imp = NULL;
+
+		Method method = class_getInstanceMethod(cls, sel);
+		char type[4] = { 0 };
+		if (method)
+			method_getReturnType(method, type, sizeof(type));
+		if (type[0] == 'd')
+			g_timestamp_imp = (touch_timestamp_imp)method_getImplementation(method);
+	}
+
+	if (g_timestamp_imp)
+		return g_timestamp_imp(touchObj, sel);
+	return [[touchObj valueForKey:@"timestamp"] doubleValue];
+}
+
 @implementation TouchConverter
 
 + (touch)convert_nstouch:(id)nsTouch
@@ -20,41 +81,22 @@ struct event_tap g_event_tap = { 0 };
 	nt.y = pos.y;
 
 	nt.phase = (int)[touchObj phase];
-	nt.timestamp = [[touchObj valueForKey:@"timestamp"] doubleValue];
+	nt.timestamp = touch_timestamp(touchObj);
+	nt.is_palm = false;
 
-	id touchIdentity = [touchObj identity];
+	// Equal identities hash equally across frames; that hash is the key.
+	uint64_t key = (uint64_t)[[touchObj identity] hash];
+	nt.identity = key;
 
-	if (!touchStates) {
-		touchStates = CFDictionaryCreateMutable(NULL, 0,
-			&kCFTypeDictionaryKeyCallBacks,
-			NULL);
-	}
+	bool created;
+	touch_state* state = touch_table_insert(&g_touch_table, key, &created);
+	touch_filter filter = current_touch_filter();
+	touch_state_update(state, &filter, created, nt.x, nt.y, nt.timestamp);
+	nt.velocity = state->vx;
+	nt.velocity_y = state->vy;
 
-	double velocity_x = 0.0;
-	touch_state* state = (touch_state*)CFDictionaryGetValue(touchStates, (__bridge const void*)(touchIdentity));
-	if (state) {
-		double dt = nt.timestamp - state->timestamp;
-		if (dt > 0)
-			velocity_x = (nt.x - state->x) / dt;
-		state->x = nt.x;
-		state->y = nt.y;
-		state->timestamp = nt.timestamp;
-	} else {
-		state = malloc(sizeof(touch_state));
-		if (state) {
-			state->x = nt.x;
-			state->y = nt.y;
-			state->timestamp = nt.timestamp;
-			CFDictionarySetValue(touchStates, (__bridge const void*)(touchIdentity), state);
-		}
-	}
-	nt.velocity = velocity_x;
-
-	if (nt.phase == 8) {
-		CFDictionaryRemoveValue(touchStates, (__bridge const void*)(touchIdentity));
-		if (state)
-			free(state);
-	}
+	if (nt.phase == END_PHASE || nt.phase == NSTouchPhaseCancelled)
+		touch_table_remove(&g_touch_table, state);
 
 	return nt;
 }
@@ -67,9 +109,17 @@ bool event_tap_enabled(struct event_tap* event_tap)
 	return result;
 }
 
-bool event_tap_begin(struct event_tap* event_tap, CGEventRef (*reference)(CGEventTapProxy proxy, CGEventType type, CGEventRef event, void* userdata))
+// Added and removed in the same modes. Common modes keep the tap serviced
+// while a menu is being tracked.
+static const CFStringRef EVENT_TAP_MODE = kCFRunLoopCommonModes;
+
+// Signalled by the input thread once the tap is on its run loop.
+static dispatch_semaphore_t g_input_thread_started = nil;
+
+static bool event_tap_create(struct event_tap* event_tap, CGEventRef (*reference)(CGEventTapProxy proxy, CGEventType type, CGEventRef event, void* userdata))
 {
-	event_tap->mask = 1 << NSEventTypeGesture;
+	// Scroll wheel events only for their phase, see input_filter_skip_scroll()
+	event_tap->mask = (1 << NSEventTypeGesture) | (1 << kCGEventScrollWheel);
 	event_tap->handle = CGEventTapCreate(
 		kCGHIDEventTap,
 		kCGHeadInsertEventTap,
@@ -84,22 +134,86 @@ bool event_tap_begin(struct event_tap* event_tap, CGEventRef (*reference)(CGEven
 			kCFAllocatorDefault,
 			event_tap->handle,
 			0);
-		CFRunLoopAddSource(CFRunLoopGetMain(),
+	}
+	return result;
+}
+
+bool event_tap_begin(struct event_tap* event_tap, CGEventRef (*reference)(CGEventTapProxy proxy, CGEventType type, CGEventRef event, void* userdata))
+{
+	bool result = event_tap_create(event_tap, reference);
+	if (result) {
+		event_tap->runloop = CFRunLoopGetMain();
+		CFRunLoopAddSource(event_tap->runloop,
 			event_tap->runloop_source,
-			kCFRunLoopDefaultMode);
+			EVENT_TAP_MODE);
 	}
 
 	return result;
 }
 
+static void* event_tap_thread(void* context)
+{
+	struct event_tap* event_tap = context;
+	pthread_setname_np("com.acsandmann.swipe.input");
+
+	event_tap->runloop = (CFRunLoopRef)CFRetain(CFRunLoopGetCurrent());
+	CFRunLoopAddSource(event_tap->runloop,
+		event_tap->runloop_source,
+		EVENT_TAP_MODE);
+	dispatch_semaphore_signal(g_input_thread_started);
+
+	// Returns once event_tap_end() removes the source and stops the loop
+	CFRunLoopRun();
+	return NULL;
+}
+
+bool event_tap_begin_on_thread(struct event_tap* event_tap, CGEventRef (*reference)(CGEventTapProxy proxy, CGEventType type, CGEventRef event, void* userdata))
+{
+	if (!event_tap_create(event_tap, reference))
+		return false;
+
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_set_qos_class_np(&attr, QOS_CLASS_USER_INTERACTIVE, 0);
+	g_input_thread_started = dispatch_semaphore_create(0);
+	event_tap->threaded = true;
+	int err = pthread_create(&event_tap->thread, &attr, event_tap_thread, event_tap);
+	pthread_attr_destroy(&attr);
+	if (err) {
+		event_tap->threaded = false;
+		log_error("Error: Could not start the input thread (%d), using the main run loop.\n", err);
+		event_tap->runloop = CFRunLoopGetMain();
+		CFRunLoopAddSource(event_tap->runloop, event_tap->runloop_source, EVENT_TAP_MODE);
+		return true;
+	}
+
+	// The tap must be on a run loop before event_tap_end() can take it off
+	dispatch_semaphore_wait(g_input_thread_started, DISPATCH_TIME_FOREVER);
+	return true;
+}
+
+// Safe to call from the tap's own callback: the input thread then stops
+// once the callback returns and is detached instead of joined.
 void event_tap_end(struct event_tap* event_tap)
 {
 	if (event_tap_enabled(event_tap)) {
 		CGEventTapEnable(event_tap->handle, false);
 		CFMachPortInvalidate(event_tap->handle);
-		CFRunLoopRemoveSource(CFRunLoopGetMain(),
+		CFRunLoopRemoveSource(event_tap->runloop,
 			event_tap->runloop_source,
-			kCFRunLoopCommonModes);
+			EVENT_TAP_MODE);
+
+		if (event_tap->threaded) {
+			CFRunLoopStop(event_tap->runloop);
+			if (pthread_equal(pthread_self(), event_tap->thread))
+				pthread_detach(event_tap->thread);
+			else
+				pthread_join(event_tap->thread, NULL);
+			CFRelease(event_tap->runloop);
+			event_tap->threaded = false;
+		}
+		event_tap->runloop = NULL;
+
 		CFRelease(event_tap->runloop_source);
 		CFRelease(event_tap->handle);
 		event_tap->handle = NULL;
@@ -0,0 +1,327 @@
+#include "gesture.h"
+#include "touch_kernel.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+void gesture_init(gesture_ctx* ctx, const Config* config, const gesture_hooks* hooks)
+{
+	memset(ctx, 0, sizeof(*ctx));
+	ctx->state = GS_IDLE;
+	ctx->config = config;
+	ctx->hooks = *hooks;
+}
+
+void gesture_set_config(gesture_ctx* ctx, const Config* config)
+{
+	ctx->config = config;
+}
+
+static void reset_gesture_state(gesture_ctx* ctx)
+{
+	ctx->state = GS_IDLE;
+	ctx->last_fire_dir = 0;
+}
+
+static swipe_direction swipe_direction_of(int axis, int sign)
+{
+	if (axis == TOUCH_AXIS_X)
+		return sign > 0 ? SWIPE_RIGHT : SWIPE_LEFT;
+	return sign > 0 ? SWIPE_UP : SWIPE_DOWN;
+}
+
+// Workspaces a committing swipe jumps: one, or with `fling` one more for
+// every fling_velocity of peak speed and every extra distance_pct of travel
+// the coalesced frames already show.
+static int fling_steps(const gesture_ctx* ctx, float delta)
+{
+	if (!ctx->config->fling)
+		return 1;
+
+	int by_velocity = 1 + (int)(fabsf(ctx->peak_vel) / ctx->config->fling_velocity);
+	int by_travel = (int)(fabsf(delta) / ctx->config->distance_pct);
+	int steps = by_velocity > by_travel ? by_velocity : by_travel;
+	return steps < ctx->config->fling_max_steps ? steps : ctx->config->fling_max_steps;
+}
+
+static bool fire_gesture(gesture_ctx* ctx, int direction, int count, float pos, double timestamp)
+{
+	if (direction == ctx->last_fire_dir)
+		return false;
+
+	ctx->last_fire_dir = direction;
+	ctx->state = GS_COMMITTED;
+	ctx->scrub_pos = pos;
+	ctx->predicted = false;
+	ctx->hooks.fire(ctx->hooks.context, ctx->fingers, swipe_direction_of(ctx->axis, direction), count, timestamp);
+	return true;
+}
+
+// Least-squares line pos = a + v*t through the armed history. Returns false
+// until there are enough samples, or if the fingers have not moved.
+static bool fit_motion(const gesture_ctx* ctx, float* velocity, float* r2)
+{
+	int n = ctx->history_count;
+	if (n < PREDICT_MIN_SAMPLES)
+		return false;
+
+	// Relative to the newest sample, so the sums keep their precision
+	double t0 = ctx->history[(ctx->history_next + GESTURE_HISTORY - 1) % GESTURE_HISTORY].t;
+	double mean_t = 0, mean_p = 0;
+	for (int i = 0; i < n; ++i) {
+		mean_t += ctx->history[i].t - t0;
+		mean_p += ctx->history[i].pos;
+	}
+	mean_t /= n;
+	mean_p /= n;
+
+	double stt = 0, spp = 0, spt = 0;
+	for (int i = 0; i < n; ++i) {
+		double dt = ctx->history[i].t - t0 - mean_t;
+		double dp = ctx->history[i].pos - mean_p;
+		stt += dt * dt;
+		spp += dp * dp;
+		spt += dp * dt;
+	}
+	if (stt <= 0 || spp <= 0)
+		return false;
+
+	*velocity = (float)(spt / stt);
+	*r2 = (float)(spt * spt / (stt * spp));
+	return true;
+}
+
+// With predictive_commit, a swipe that is well under way and moving on a
+// steady line fires as soon as its projection predict_horizon ahead
+// crosses distance_pct, instead of waiting for the fingers to get there.
+static bool predicts_commit(const gesture_ctx* ctx, float delta)
+{
+	if (!ctx->config->predictive_commit || fabsf(delta) < ctx->config->distance_pct * PREDICT_MIN_TRAVEL)
+		return false;
+
+	float velocity, r2;
+	if (!fit_motion(ctx, &velocity, &r2) || r2 < ctx->config->predict_min_r2 || velocity * delta <= 0)
+		return false;
+	return fabsf(delta + velocity * ctx->config->predict_horizon) >= ctx->config->distance_pct;
+}
+
+// A predictive commit is a misprediction if the fingers stopped or turned
+// back before actually covering distance_pct.
+static void settle_prediction(gesture_ctx* ctx)
+{
+	if (ctx->predicted && !ctx->reached)
+		atomic_fetch_add_explicit(&ctx->mispredicted, 1, memory_order_relaxed);
+	ctx->predicted = false;
+}
+
+static void record_motion(gesture_ctx* ctx, float pos, double timestamp)
+{
+	ctx->history[ctx->history_next] = (motion_sample) { pos, timestamp };
+	ctx->history_next = (ctx->history_next + 1) % GESTURE_HISTORY;
+	if (ctx->history_count < GESTURE_HISTORY)
+		ctx->history_count++;
+}
+
+static void abandon_gesture(gesture_ctx* ctx, double timestamp)
+{
+	reset_gesture_state(ctx);
+	ctx->hooks.abandoned(ctx->hooks.context, timestamp);
+}
+
+static void arm_gesture(gesture_ctx* ctx, int axis, int fingers, const touch_summary* sum)
+{
+	float vel = sum->avg_vel[axis];
+	ctx->state = GS_ARMED;
+	ctx->axis = axis;
+	ctx->fingers = fingers;
+	ctx->start[TOUCH_AXIS_X] = sum->avg[TOUCH_AXIS_X];
+	ctx->start[TOUCH_AXIS_Y] = sum->avg[TOUCH_AXIS_Y];
+	ctx->peak_vel = vel;
+	ctx->dir = (vel >= 0) ? 1 : -1;
+	ctx->history_count = ctx->history_next = 0;
+}
+
+static void rebase(gesture_ctx* ctx, const touch_frame* frame)
+{
+	memcpy(ctx->base[TOUCH_AXIS_X], frame->x, sizeof(ctx->base[TOUCH_AXIS_X]));
+	memcpy(ctx->base[TOUCH_AXIS_Y], frame->y, sizeof(ctx->base[TOUCH_AXIS_Y]));
+}
+
+static bool handle_committed_state(gesture_ctx* ctx, const touch_frame* frame, const touch_summary* sum)
+{
+	int count = frame->count;
+	if (!count || sum->ended == count) {
+		settle_prediction(ctx);
+		reset_gesture_state(ctx);
+		return true;
+	}
+
+	int axis = ctx->axis;
+	float pos = sum->avg[axis];
+	float delta = pos - ctx->start[axis];
+	if (ctx->predicted && delta * ctx->last_fire_dir >= ctx->config->distance_pct)
+		ctx->reached = true;
+
+	// Scrub: every further distance_pct of travel, either way, is another step
+	if (ctx->config->scrub) {
+		float travel = pos - ctx->scrub_pos;
+		int steps = (int)(travel / ctx->config->distance_pct);
+		if (steps) {
+			ctx->scrub_pos += steps * ctx->config->distance_pct;
+			ctx->hooks.fire(ctx->hooks.context, ctx->fingers, swipe_direction_of(axis, steps), abs(steps),
+				frame->timestamp);
+		}
+		return true;
+	}
+
+	if ((delta * ctx->last_fire_dir) < 0 && fabsf(delta) >= ctx->config->min_travel) {
+		settle_prediction(ctx);
+		arm_gesture(ctx, axis, ctx->fingers, sum);
+		rebase(ctx, frame);
+	}
+
+	return true;
+}
+
+// Arms along `axis` if at least half the fingers moved that way and it
+// dominates the other axis.
+static bool try_arm(gesture_ctx* ctx, int axis, int count, const touch_summary* sum, double timestamp)
+{
+	int other = !axis;
+	float vel = sum->avg_vel[axis];
+	bool fast = fabsf(vel) >= ctx->config->velocity_pct * FAST_VEL_FACTOR;
+
+	// At least half the fingers should have moved (allow some to lag)
+	bool moved = (sum->moved[axis][fast ? TOUCH_FAST : TOUCH_SLOW] >= (count + 1) / 2);
+
+	float delta = sum->avg[axis] - ctx->start[axis];
+	float cross = sum->avg[other] - ctx->start[other];
+
+	if (!moved || !(fast || fabsf(delta) >= ACTIVATE_PCT || fabsf(vel) >= ctx->config->velocity_pct * 0.5f))
+		return false;
+	// The swipe axis must dominate, unless it is clearly a flick along it
+	if (!(fabsf(delta) > fabsf(cross) || fast))
+		return false;
+
+	arm_gesture(ctx, axis, count, sum);
+	ctx->hooks.armed(ctx->hooks.context, timestamp);
+	return true;
+}
+
+// Horizontal first: a fast diagonal flick goes to the horizontal binding.
+static void handle_idle_state(gesture_ctx* ctx, int count, int axes, const touch_summary* sum, double timestamp)
+{
+	if ((axes & (1 << TOUCH_AXIS_X)) && try_arm(ctx, TOUCH_AXIS_X, count, sum, timestamp))
+		return;
+	if (axes & (1 << TOUCH_AXIS_Y))
+		try_arm(ctx, TOUCH_AXIS_Y, count, sum, timestamp);
+}
+
+static void handle_armed_state(gesture_ctx* ctx, const touch_summary* sum, double timestamp)
+{
+	int axis = ctx->axis;
+	int other = !axis;
+	float pos = sum->avg[axis];
+	float vel = sum->avg_vel[axis];
+	float delta = pos - ctx->start[axis];
+	float cross = sum->avg[other] - ctx->start[other];
+	record_motion(ctx, pos, timestamp);
+
+	// Reset if the other axis takes over (with small tolerance for diagonal)
+	if (fabsf(cross) > fabsf(delta) * 1.2f) {
+		abandon_gesture(ctx, timestamp);
+		return;
+	}
+
+	// Fingers that stalled or moved against the swipe
+	int k = fabsf(vel) >= ctx->config->velocity_pct * FAST_VEL_FACTOR ? TOUCH_FAST : TOUCH_SLOW;
+	int mismatch_count = delta > 0 ? sum->stalled_or_neg[axis][k]
+		: delta < 0 ? sum->stalled_or_pos[axis][k] : sum->stalled[axis][k];
+	if (mismatch_count > ctx->config->swipe_tolerance) {
+		abandon_gesture(ctx, timestamp);
+		return;
+	}
+
+	if (fabsf(vel) > fabsf(ctx->peak_vel)) {
+		ctx->peak_vel = vel;
+		ctx->dir = (vel >= 0) ? 1 : -1;
+	}
+
+	// Fire based on distance
+	if (fabsf(delta) >= ctx->config->distance_pct) {
+		fire_gesture(ctx, delta > 0 ? 1 : -1, fling_steps(ctx, delta), pos, timestamp);
+	}
+	// Or fire on fast intentional swipes (for medium/high sensitivity)
+	// Must reach at least fast_distance_factor of the threshold distance
+	else if (fabsf(vel) >= ctx->config->fast_velocity_threshold &&
+	         fabsf(delta) >= ctx->config->distance_pct * ctx->config->fast_distance_factor) {
+		fire_gesture(ctx, delta > 0 ? 1 : -1, fling_steps(ctx, delta), pos, timestamp);
+	}
+	// Or fire early when the motion fit says it will get there
+	else if (predicts_commit(ctx, delta)) {
+		if (fire_gesture(ctx, delta > 0 ? 1 : -1, fling_steps(ctx, delta), pos, timestamp)) {
+			ctx->predicted = true;
+			ctx->reached = false;
+			atomic_fetch_add_explicit(&ctx->predicted_commits, 1, memory_order_relaxed);
+		}
+	}
+}
+
+void gesture_process(gesture_ctx* ctx, const touch_frame* frame)
+{
+	int count = frame->count;
+	int prev_count = ctx->prev_count;
+	ctx->prev_count = count;
+
+	touch_summary sum = { 0 };
+	if (count) {
+		const float travel[2] = { ctx->config->min_travel, ctx->config->min_travel_fast };
+		const float step[2] = { ctx->config->min_step, ctx->config->min_step_fast };
+		const float* const base[2] = { ctx->base[TOUCH_AXIS_X], ctx->base[TOUCH_AXIS_Y] };
+		const float* const prev[2] = { ctx->prev[TOUCH_AXIS_X], ctx->prev[TOUCH_AXIS_Y] };
+		touch_frame_summarize(frame, base, prev, travel, step, &sum);
+	}
+
+	if (ctx->state == GS_COMMITTED) {
+		if (handle_committed_state(ctx, frame, &sum))
+			return;
+	}
+
+	// A frame with a different count only re-bases: its slots do not line up
+	// with prev and base, which may also be from long ago, as the input
+	// filter drops repeats of counts too small to swipe with.
+	int axes = config_swipe_axes(ctx->config, count);
+	if (!axes || count != prev_count || (ctx->state == GS_ARMED && count != ctx->fingers)) {
+		if (ctx->state == GS_ARMED) {
+			ctx->state = GS_IDLE;
+			ctx->hooks.abandoned(ctx->hooks.context, frame->timestamp);
+		}
+
+		memcpy(ctx->prev[TOUCH_AXIS_X], frame->x, sizeof(ctx->prev[TOUCH_AXIS_X]));
+		memcpy(ctx->prev[TOUCH_AXIS_Y], frame->y, sizeof(ctx->prev[TOUCH_AXIS_Y]));
+		rebase(ctx, frame);
+		return;
+	}
+
+	if (ctx->state == GS_IDLE) {
+		handle_idle_state(ctx, count, axes, &sum, frame->timestamp);
+	} else if (ctx->state == GS_ARMED) {
+		handle_armed_state(ctx, &sum, frame->timestamp);
+	}
+
+	memcpy(ctx->prev[TOUCH_AXIS_X], frame->x, sizeof(ctx->prev[TOUCH_AXIS_X]));
+	memcpy(ctx->prev[TOUCH_AXIS_Y], frame->y, sizeof(ctx->prev[TOUCH_AXIS_Y]));
+	if (ctx->state == GS_IDLE)
+		rebase(ctx, frame);
+}
+
+bool gesture_is_transition_frame(const touch_frame* frame, const touch_frame* next)
+{
+	if (frame->count != next->count || frame->pad != next->pad)
+		return true;
+	for (int i = 0; i < frame->count; ++i) {
+		if (frame->phase[i] == END_PHASE)
+			return true;
+	}
+	return false;
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "config.h"
+#include "touch_ring.h"
+
+#define ACTIVATE_PCT 0.05f
+#define FAST_VEL_FACTOR 0.80f
+#define GESTURE_HISTORY 8 // frames kept for the predictive commit fit
+#define PREDICT_MIN_SAMPLES 4
+#define PREDICT_MIN_TRAVEL 0.5f // fraction of distance_pct before predicting
+
+typedef enum {
+	GS_IDLE,
+	GS_ARMED,
+	GS_COMMITTED
+} gesture_state;
+
+typedef struct {
+	float pos; // along the swipe axis
+	double t;
+} motion_sample;
+
+// What the state machine does besides changing state. The app wires these
+// to the AeroSpace client; the replay driver just logs them.
+typedef struct {
+	void (*armed)(void* context, double timestamp);
+	void (*abandoned)(void* context, double timestamp);
+	// count is in workspaces for workspace swipes, otherwise repeats.
+	void (*fire)(void* context, int fingers, swipe_direction direction, int count, double timestamp);
+	void* context;
+} gesture_hooks;
+
+// Gesture context structure
+typedef struct {
+	gesture_state state;
+	int axis, fingers; // of the armed or committed swipe
+	float start[2], peak_vel; // start by axis, peak velocity along `axis`
+	int dir, last_fire_dir; // signs along `axis`
+	float scrub_pos; // position of the last step taken while committed
+	float prev[2][MAX_TOUCHES], base[2][MAX_TOUCHES]; // by axis
+	int prev_count; // touches in the frame prev and base were taken from
+	motion_sample history[GESTURE_HISTORY]; // average position while armed, ring
+	int history_count, history_next;
+	bool predicted; // committed on a projection rather than real travel
+	bool reached; // ...and the fingers have since covered distance_pct
+	const Config* config;
+	gesture_hooks hooks;
+	_Atomic uint64_t predicted_commits;
+	_Atomic uint64_t mispredicted;
+} gesture_ctx;
+
+// `config` is read on every frame and must stay valid until it is replaced
+// with gesture_set_config().
+void gesture_init(gesture_ctx* ctx, const Config* config, const gesture_hooks* hooks);
+
+// Takes effect from the next frame. Call from the thread that processes
+// frames.
+void gesture_set_config(gesture_ctx* ctx, const Config* config);
+
+// Advances the state machine by one frame. Every finger count and axis
+// with a binding (config_swipe_axes()) is recognised by the one machine:
+// the axis is picked when the swipe arms. Frames must arrive in capture
+// order, from one thread at a time.
+void gesture_process(gesture_ctx* ctx, const touch_frame* frame);
+
+// A frame that changes the finger set or ends touches drives state
+// transitions (re-basing, END_PHASE resets) and must never be skipped. Nor
+// may a frame followed by one from another pad, which it does not supersede.
+bool gesture_is_transition_frame(const touch_frame* frame, const touch_frame* next);
@@ -1,9 +1,13 @@
 #include "haptic.h"
+#include "log.h"
+#include "multitouch.h"
 
 #include <CoreFoundation/CoreFoundation.h>
 #include <IOKit/IOKitLib.h>
 #include <mach/mach_error.h>
+#include <stdatomic.h>
 #include <stdio.h>
+#include <time.h>
 
 #define CF_RELEASE(obj)      \
 	do {                     \
@@ -13,73 +17,32 @@
 		}                    \
 	} while (0)
 
-static const CFStringRef kMTRegistryKeyID = CFSTR("Multitouch ID");
-
 CFTypeRef haptic_open(uint64_t deviceID)
 {
 	CFTypeRef act = MTActuatorCreateFromDeviceID(deviceID);
 	if (!act) {
-		fprintf(stderr, "No actuator for device %llu\n",
+		log_warn("No actuator for device %llu\n",
 			(unsigned long long)deviceID);
 		return NULL;
 	}
 	IOReturn kr = MTActuatorOpen(act);
 	if (kr != kIOReturnSuccess) {
-		fprintf(stderr, "MTActuatorOpen: 0x%04x (%s)\n",
+		log_warn("MTActuatorOpen: 0x%04x (%s)\n",
 			kr, mach_error_string(kr));
 		CF_RELEASE(act);
 	}
 	return act;
 }
 
-static void iterate_multitouch(io_iterator_t iter,
-	void (^callback)(uint64_t devID))
-{
-	io_object_t dev;
-	while ((dev = IOIteratorNext(iter))) {
-
-		CFNumberRef idRef = (CFNumberRef)
-			IORegistryEntryCreateCFProperty(dev, kMTRegistryKeyID,
-				kCFAllocatorDefault, 0);
-
-		if (idRef && CFGetTypeID(idRef) == CFNumberGetTypeID()) {
-			uint64_t id = 0;
-			CFNumberGetValue(idRef, kCFNumberSInt64Type, &id);
-			callback(id);
-		}
-
-		CF_RELEASE(idRef);
-		IOObjectRelease(dev);
-	}
-}
-
-static io_iterator_t matching_iterator(void)
-{
-	io_iterator_t it = MACH_PORT_NULL;
-	kern_return_t kr = IOServiceGetMatchingServices(
-		kIOMainPortDefault,
-		IOServiceMatching("AppleMultitouchDevice"),
-		&it);
-	if (kr != KERN_SUCCESS)
-		return MACH_PORT_NULL;
-
-	return it;
-}
-
 CFTypeRef haptic_open_default(void)
 {
-	io_iterator_t it = matching_iterator();
-	if (it == MACH_PORT_NULL)
-		return NULL;
-
 	__block CFTypeRef chosen = NULL;
 
-	iterate_multitouch(it, ^(uint64_t id) {
+	multitouch_iterate_devices(^(uint64_t id) {
 		if (!chosen)
 			chosen = haptic_open(id);
 	});
 
-	IOObjectRelease(it);
 	return chosen;
 }
 
@@ -87,17 +50,12 @@ CFMutableArrayRef haptic_open_all(void)
 {
 	CFMutableArrayRef arr = CFArrayCreateMutable(kCFAllocatorDefault, 0, &kCFTypeArrayCallBacks);
 
-	io_iterator_t it = matching_iterator();
-	if (it == MACH_PORT_NULL)
-		return arr;
-
-	iterate_multitouch(it, ^(uint64_t id) {
+	multitouch_iterate_devices(^(uint64_t id) {
 		CFTypeRef act = haptic_open(id);
 		if (act)
 			CFArrayAppendValue(arr, act);
 	});
 
-	IOObjectRelease(it);
 	return arr;
 }
 
@@ -109,11 +67,34 @@ static inline IOReturn _actuate(CFTypeRef act, int32_t pattern)
 	return MTActuatorActuate(act, pattern, 0, 0.0f, 0.0f);
 }
 
+static _Atomic uint64_t g_error_logged_at = 0; // uptime ns
+static _Atomic uint64_t g_errors_suppressed = 0;
+
+// A detached or sleeping actuator fails every play; one line per interval
+// says so without flooding the log.
+static void log_actuate_error(IOReturn kr)
+{
+	uint64_t now = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+	uint64_t logged_at = atomic_load_explicit(&g_error_logged_at, memory_order_relaxed);
+	if ((logged_at && now - logged_at < HAPTIC_ERROR_INTERVAL_SECS * NSEC_PER_SEC)
+		|| !atomic_compare_exchange_strong(&g_error_logged_at, &logged_at, now)) {
+		atomic_fetch_add_explicit(&g_errors_suppressed, 1, memory_order_relaxed);
+		return;
+	}
+
+	uint64_t suppressed = atomic_exchange_explicit(&g_errors_suppressed, 0, memory_order_relaxed);
+	if (suppressed)
+		log_error("haptic_actuate: 0x%04x (%s), %llu more since the last report\n", kr, mach_error_string(kr),
+			(unsigned long long)suppressed);
+	else
+		log_error("haptic_actuate: 0x%04x (%s)\n", kr, mach_error_string(kr));
+}
+
 bool haptic_actuate(CFTypeRef act, int32_t pattern)
 {
 	IOReturn kr = _actuate(act, pattern);
 	if (kr != kIOReturnSuccess) {
-		fprintf(stderr, "haptic_actuate: 0x%04x (%s)\n", kr, mach_error_string(kr));
+		log_actuate_error(kr);
 		return false;
 	}
 	return true;
@@ -146,3 +127,44 @@ void haptic_close_all(CFArrayRef arr)
 
 	CFRelease(arr);
 }
+
+static dispatch_queue_t g_haptic_queue = NULL;
+
+static void play_channel(void* context)
+{
+	haptic_channel* channel = context;
+	uint64_t now = clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+	if (channel->last_played && now - channel->last_played < HAPTIC_COALESCE_MS * NSEC_PER_MSEC)
+		return;
+
+	channel->last_played = now;
+	haptic_actuate(channel->actuator, channel->pattern);
+}
+
+bool haptic_channel_init(haptic_channel* channel, CFTypeRef actuator, int32_t pattern)
+{
+	if (!g_haptic_queue) {
+		dispatch_queue_attr_t attr = dispatch_queue_attr_make_with_qos_class(
+			DISPATCH_QUEUE_SERIAL, QOS_CLASS_USER_INTERACTIVE, 0);
+		g_haptic_queue = dispatch_queue_create("com.acsandmann.swipe.haptic", attr);
+	}
+
+	dispatch_source_t source = dispatch_source_create(DISPATCH_SOURCE_TYPE_DATA_OR, 0, 0, g_haptic_queue);
+	if (!source)
+		return false;
+
+	channel->actuator = actuator;
+	channel->pattern = pattern;
+	channel->last_played = 0;
+	channel->source = source;
+	dispatch_set_context(channel->source, channel);
+	dispatch_source_set_event_handler_f(channel->source, play_channel);
+	dispatch_resume(channel->source);
+	return true;
+}
+
+void haptic_channel_play(haptic_channel* channel)
+{
+	if (channel->source)
+		dispatch_source_merge_data(channel->source, 1);
+}
@@ -1,6 +1,16 @@
 #define HAPTIC_H
 
 #include <IOKit/IOKitLib.h>
+#include <dispatch/dispatch.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Plays closer together than this are felt as one; the later ones are dropped
+#define HAPTIC_COALESCE_MS 60
+
+// At most one actuation error is logged per interval, with a count of the
+// ones suppressed in between
+#define HAPTIC_ERROR_INTERVAL_SECS 10
 
 extern CFTypeRef MTActuatorCreateFromDeviceID(UInt64 deviceID);
 extern IOReturn MTActuatorOpen(CFTypeRef actuatorRef);
@@ -19,3 +29,20 @@ void haptic_actuate_all(CFArrayRef actuators, int32_t pattern);
 
 void haptic_close(CFTypeRef actuator);
 void haptic_close_all(CFArrayRef actuators);
+
+// Plays a pattern on one actuator from a shared background queue, so the
+// caller never waits on IOKit. Requests are merged in a data source: a
+// burst (a scrub, a fling) plays once.
+typedef struct {
+	CFTypeRef actuator;
+	int32_t pattern;
+	dispatch_source_t source;
+	uint64_t last_played; // haptic queue only, uptime ns
+} haptic_channel;
+
+// `actuator` must stay open while the channel is in use. Returns false,
+// leaving the channel unset, if the source could not be created.
+bool haptic_channel_init(haptic_channel* channel, CFTypeRef actuator, int32_t pattern);
+
+// Lock-free and allocation-free; callable from any thread.
+void haptic_channel_play(haptic_channel* channel);
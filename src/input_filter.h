@@ -0,0 +1,96 @@
+#pragma once
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Private kCGEventGestureHIDType: the IOHIDEventType behind a gesture event
+#define CG_EVENT_GESTURE_HID_TYPE 110
+#define INPUT_FILTER_SUBTYPES 64
+// Events of a subtype converted before trusting that it never has touches
+#define INPUT_FILTER_CALIBRATION 64
+// While scrolling, one gesture event in this many is still converted
+#define INPUT_FILTER_SCROLL_SAMPLE 8
+
+// Drops gesture events that cannot affect a swipe before they are turned
+// into NSEvents and NSTouches. Which HID subtypes carry touches is not
+// documented, so it is learned: every subtype is converted for its first
+// INPUT_FILTER_CALIBRATION events, and afterwards skipped if none of them
+// had any. Nothing is skipped while fingers are down or a gesture is under
+// way, so a lift or a re-base is never lost. Input thread only, apart from
+// the counters.
+typedef struct {
+	uint32_t seen[INPUT_FILTER_SUBTYPES];
+	bool has_touches[INPUT_FILTER_SUBTYPES];
+	int last_count; // touches of the last event let through
+	bool scrolling; // a two-finger scroll is under way
+	uint32_t scroll_events; // gesture events seen while scrolling
+	_Atomic uint64_t by_subtype; // skipped before NSEvent conversion
+	_Atomic uint64_t by_scroll; // skipped before NSEvent conversion, while scrolling
+	_Atomic uint64_t by_count; // skipped before NSTouch conversion
+} input_filter;
+
+static inline bool input_filter_known(const input_filter* filter, int64_t subtype)
+{
+	return subtype >= 0 && subtype < INPUT_FILTER_SUBTYPES && filter->seen[subtype] >= INPUT_FILTER_CALIBRATION;
+}
+
+static inline bool input_filter_skip_subtype(input_filter* filter, int64_t subtype, bool busy)
+{
+	if (busy || filter->last_count || !input_filter_known(filter, subtype) || filter->has_touches[subtype])
+		return false;
+
+	atomic_fetch_add_explicit(&filter->by_subtype, 1, memory_order_relaxed);
+	return true;
+}
+
+// Scroll wheel events carry the phase of a trackpad scroll, which is known
+// to have two fingers down while it is under way. Only events with a scroll
+// phase should be passed: mouse wheels and momentum have none.
+static inline void input_filter_scroll_phase(input_filter* filter, bool scrolling)
+{
+	filter->scrolling = scrolling;
+	filter->scroll_events = 0;
+}
+
+// Two-finger scrolls are the bulk of the gesture events that have touches,
+// so when a swipe needs more fingers they are skipped without converting
+// them to learn the count. In case a third finger lands without the scroll
+// ending, every INPUT_FILTER_SCROLL_SAMPLE-th event is still converted, and
+// input_filter_skip_count() ends the scroll on any other count.
+static inline bool input_filter_skip_scroll(input_filter* filter, int fingers, bool busy)
+{
+	if (busy || !filter->scrolling || fingers <= 2 || filter->last_count >= fingers
+		|| ++filter->scroll_events % INPUT_FILTER_SCROLL_SAMPLE == 0)
+		return false;
+
+	atomic_fetch_add_explicit(&filter->by_scroll, 1, memory_order_relaxed);
+	return true;
+}
+
+static inline void input_filter_learn(input_filter* filter, int64_t subtype, int touches)
+{
+	if (subtype < 0 || subtype >= INPUT_FILTER_SUBTYPES || filter->seen[subtype] >= INPUT_FILTER_CALIBRATION)
+		return;
+
+	filter->seen[subtype]++;
+	if (touches)
+		filter->has_touches[subtype] = true;
+}
+
+// Fewer fingers than a swipe needs can only matter to an idle gesture when
+// the count changes or a touch ends, so repeats of such a frame are
+// skipped; the gesture re-bases on the first frame of a new count, so what
+// it last saw being stale does not matter. More fingers than needed always
+// pass: palm rejection needs them.
+static inline bool input_filter_skip_count(input_filter* filter, int count, bool ended, int fingers, bool busy)
+{
+	bool repeat = count == filter->last_count;
+	filter->last_count = count;
+	if (count != 2)
+		filter->scrolling = false;
+	if (busy || !repeat || ended || count >= fingers)
+		return false;
+
+	atomic_fetch_add_explicit(&filter->by_count, 1, memory_order_relaxed);
+	return true;
+}
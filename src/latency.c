@@ -0,0 +1,61 @@
+#include <stdio.h>
+
+#include "latency.h"
+
+latency_histogram g_latency[LATENCY_STAGES];
+os_log_t g_latency_log = OS_LOG_DISABLED;
+
+static const char* const STAGE_NAMES[LATENCY_STAGES] = {
+	[LATENCY_INPUT] = "input",
+	[LATENCY_PUBLISH] = "publish",
+	[LATENCY_DEQUEUE] = "dequeue",
+	[LATENCY_GESTURE] = "gesture",
+	[LATENCY_FIRE] = "fire",
+	[LATENCY_WRITE] = "write",
+	[LATENCY_ACK] = "ack",
+	[LATENCY_SWITCH] = "switch",
+};
+
+void latency_init(void)
+{
+	g_latency_log = os_log_create("com.acsandmann.swipe", "pipeline");
+}
+
+// Upper bound of the bucket holding the q-th quantile, capped at the max.
+static double quantile_ms(const uint64_t* buckets, uint64_t count, uint64_t max_ns, double q)
+{
+	uint64_t rank = (uint64_t)(q * (double)count + 0.5);
+	if (rank < 1)
+		rank = 1;
+
+	uint64_t seen = 0;
+	for (int i = 0; i < LATENCY_BUCKETS; ++i) {
+		seen += buckets[i];
+		if (seen >= rank) {
+			uint64_t ns = (latency_bucket_limit(i) + 1) * 1000;
+			return (double)(ns < max_ns ? ns : max_ns) / 1e6;
+		}
+	}
+	return (double)max_ns / 1e6;
+}
+
+void latency_dump(void)
+{
+	for (int stage = 0; stage < LATENCY_STAGES; ++stage) {
+		latency_histogram* h = &g_latency[stage];
+
+		// Snapshot the buckets first: samples landing meanwhile only make
+		// count lag the buckets, never overshoot them.
+		uint64_t buckets[LATENCY_BUCKETS];
+		uint64_t count = atomic_load_explicit(&h->count, memory_order_relaxed);
+		for (int i = 0; i < LATENCY_BUCKETS; ++i)
+			buckets[i] = atomic_load_explicit(&h->buckets[i], memory_order_relaxed);
+		uint64_t max_ns = atomic_load_explicit(&h->max_ns, memory_order_relaxed);
+		if (!count)
+			continue;
+
+		fprintf(stderr, "latency %-8s n=%llu p50=%.3fms p99=%.3fms max=%.3fms\n", STAGE_NAMES[stage],
+			(unsigned long long)count, quantile_ms(buckets, count, max_ns, 0.50),
+			quantile_ms(buckets, count, max_ns, 0.99), (double)max_ns / 1e6);
+	}
+}
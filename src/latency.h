@@ -0,0 +1,84 @@
+#pragma once
+#include <os/signpost.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <time.h>
+
+// Log2 buckets of microseconds with four sub-buckets per power of two
+// (<= 25% error), up to ~16s.
+#define LATENCY_BUCKETS 96
+
+// Stages of a swipe, each measured from the end of the previous one.
+typedef enum {
+	LATENCY_INPUT, // touch timestamp -> event tap / contact callback
+	LATENCY_PUBLISH, // callback -> frame committed to the ring
+	LATENCY_DEQUEUE, // committed -> picked up by the gesture queue
+	LATENCY_GESTURE, // state machine time per frame
+	LATENCY_FIRE, // timestamp of the committing frame -> fire decision
+	LATENCY_WRITE, // fire decision -> `workspace` written to the socket
+	LATENCY_ACK, // any command written -> its response parsed
+	LATENCY_SWITCH, // timestamp of the committing frame -> switch acknowledged
+	LATENCY_STAGES
+} latency_stage;
+
+typedef struct {
+	_Atomic uint64_t buckets[LATENCY_BUCKETS];
+	_Atomic uint64_t count;
+	_Atomic uint64_t max_ns;
+} latency_histogram;
+
+extern latency_histogram g_latency[LATENCY_STAGES];
+
+// Signpost log for Instruments' os_signpost instrument. Disabled until
+// latency_init().
+extern os_log_t g_latency_log;
+
+void latency_init(void);
+
+// Prints count/p50/p99/max of every stage that has samples to stderr.
+void latency_dump(void);
+
+// Same clock as NSEvent/NSTouch and MultitouchSupport timestamps, so touch
+// timestamps convert with latency_from_seconds().
+static inline uint64_t latency_now(void)
+{
+	return clock_gettime_nsec_np(CLOCK_UPTIME_RAW);
+}
+
+static inline uint64_t latency_from_seconds(double seconds)
+{
+	return (uint64_t)(seconds * 1e9);
+}
+
+static inline int latency_bucket(uint64_t us)
+{
+	if (us < 4)
+		return (int)us;
+	int log = 63 - __builtin_clzll(us);
+	int bucket = 4 * (log - 1) + (int)((us >> (log - 2)) & 3);
+	return bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1;
+}
+
+// Largest value, in microseconds, that lands in `bucket`.
+static inline uint64_t latency_bucket_limit(int bucket)
+{
+	if (bucket < 4)
+		return (uint64_t)bucket;
+	int log = bucket / 4 + 1;
+	return ((uint64_t)(5 + bucket % 4) << (log - 2)) - 1;
+}
+
+// Lock-free; callable from any thread. An interval that ends before it
+// starts (timestamps from another clock) counts as zero.
+static inline void latency_record(latency_stage stage, uint64_t start_ns, uint64_t end_ns)
+{
+	latency_histogram* h = &g_latency[stage];
+	uint64_t ns = end_ns > start_ns ? end_ns - start_ns : 0;
+	atomic_fetch_add_explicit(&h->buckets[latency_bucket(ns / 1000)], 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+
+	uint64_t max = atomic_load_explicit(&h->max_ns, memory_order_relaxed);
+	while (ns > max && !atomic_compare_exchange_weak_explicit(&h->max_ns, &max, ns, memory_order_relaxed,
+			   memory_order_relaxed))
+		;
+}
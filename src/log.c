@@ -0,0 +1,132 @@
+#include <dispatch/dispatch.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "log.h"
+
+// Must be a power of two.
+#define LOG_RING_SLOTS 256
+#define LOG_MESSAGE_MAX 248
+
+// Bounded multi-producer ring (Vyukov): a slot's sequence says whose turn
+// it is. Producers claim a position by CAS on head and publish the slot by
+// storing position + 1; the drain releases it for the next lap by storing
+// position + LOG_RING_SLOTS.
+typedef struct {
+	_Atomic uint32_t sequence;
+	log_level level;
+	char text[LOG_MESSAGE_MAX];
+} log_slot;
+
+static log_slot g_slots[LOG_RING_SLOTS];
+static _Atomic uint32_t g_head __attribute__((aligned(64)));
+static uint32_t g_tail; // log queue only
+static _Atomic uint64_t g_dropped;
+static _Atomic int g_level = LOG_LEVEL_INFO;
+static _Atomic bool g_started;
+static dispatch_queue_t g_log_queue;
+static dispatch_source_t g_log_source;
+
+static void write_message(log_level level, const char* text)
+{
+	fputs(text, level <= LOG_LEVEL_WARN ? stderr : stdout);
+}
+
+static void drain(__unused void* context)
+{
+	for (;; ++g_tail) {
+		log_slot* slot = &g_slots[g_tail & (LOG_RING_SLOTS - 1)];
+		uint32_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+		if (sequence != g_tail + 1)
+			break;
+
+		write_message(slot->level, slot->text);
+		atomic_store_explicit(&slot->sequence, g_tail + LOG_RING_SLOTS, memory_order_release);
+	}
+
+	uint64_t dropped = atomic_exchange_explicit(&g_dropped, 0, memory_order_relaxed);
+	if (dropped)
+		fprintf(stderr, "Warning: log ring full, dropped %llu messages\n", (unsigned long long)dropped);
+
+	fflush(stdout);
+	fflush(stderr);
+}
+
+void log_start(log_level level)
+{
+	if (atomic_load(&g_started))
+		return;
+
+	for (uint32_t i = 0; i < LOG_RING_SLOTS; ++i)
+		atomic_init(&g_slots[i].sequence, i);
+	log_set_level(level);
+
+	dispatch_queue_attr_t attr = dispatch_queue_attr_make_with_qos_class(
+		DISPATCH_QUEUE_SERIAL, QOS_CLASS_UTILITY, 0);
+	g_log_queue = dispatch_queue_create("com.acsandmann.swipe.log", attr);
+	g_log_source = dispatch_source_create(DISPATCH_SOURCE_TYPE_DATA_OR, 0, 0, g_log_queue);
+	dispatch_source_set_event_handler_f(g_log_source, drain);
+	dispatch_resume(g_log_source);
+
+	atomic_store(&g_started, true);
+	atexit(log_flush);
+}
+
+void log_set_level(log_level level)
+{
+	atomic_store_explicit(&g_level, level, memory_order_relaxed);
+}
+
+void log_flush(void)
+{
+	if (atomic_load(&g_started))
+		dispatch_sync_f(g_log_queue, NULL, drain);
+}
+
+void log_write(log_level level, const char* fmt, ...)
+{
+	if ((int)level > atomic_load_explicit(&g_level, memory_order_relaxed))
+		return;
+
+	va_list args;
+	va_start(args, fmt);
+
+	if (!atomic_load_explicit(&g_started, memory_order_acquire)) {
+		vfprintf(level <= LOG_LEVEL_WARN ? stderr : stdout, fmt, args);
+		va_end(args);
+		return;
+	}
+
+	uint32_t position = atomic_load_explicit(&g_head, memory_order_relaxed);
+	log_slot* slot;
+	for (;;) {
+		slot = &g_slots[position & (LOG_RING_SLOTS - 1)];
+		uint32_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+		int32_t lag = (int32_t)(sequence - position);
+		if (lag == 0) {
+			if (atomic_compare_exchange_weak_explicit(&g_head, &position, position + 1,
+					memory_order_relaxed, memory_order_relaxed))
+				break;
+		} else if (lag < 0) {
+			// The drain is a full lap behind
+			atomic_fetch_add_explicit(&g_dropped, 1, memory_order_relaxed);
+			va_end(args);
+			return;
+		} else {
+			position = atomic_load_explicit(&g_head, memory_order_relaxed);
+		}
+	}
+
+	int len = vsnprintf(slot->text, sizeof(slot->text), fmt, args);
+	va_end(args);
+	if (len >= (int)sizeof(slot->text))
+		slot->text[sizeof(slot->text) - 2] = '\n';
+	slot->level = level;
+	atomic_store_explicit(&slot->sequence, position + 1, memory_order_release);
+
+	// Merging into a data source neither allocates nor queues a work item.
+	dispatch_source_merge_data(g_log_source, 1);
+}
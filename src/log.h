@@ -0,0 +1,29 @@
+#pragma once
+#include <stdarg.h>
+
+typedef enum {
+	LOG_LEVEL_ERROR,
+	LOG_LEVEL_WARN,
+	LOG_LEVEL_INFO,
+	LOG_LEVEL_DEBUG
+} log_level;
+
+// Starts the background drain. From then on log_write() only formats into
+// an in-memory ring and never blocks on stdout/stderr; before it (and in
+// tools that never call it) messages are written synchronously.
+void log_start(log_level level);
+
+void log_set_level(log_level level);
+
+// Writes everything queued so far. Registered with atexit by log_start().
+void log_flush(void);
+
+// Errors and warnings go to stderr, the rest to stdout. Messages longer
+// than a ring slot are truncated; if the ring is full they are dropped and
+// counted instead.
+void log_write(log_level level, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+
+#define log_error(...) log_write(LOG_LEVEL_ERROR, __VA_ARGS__)
+#define log_warn(...) log_write(LOG_LEVEL_WARN, __VA_ARGS__)
+#define log_info(...) log_write(LOG_LEVEL_INFO, __VA_ARGS__)
+#define log_debug(...) log_write(LOG_LEVEL_DEBUG, __VA_ARGS__)
@@ -2,19 +2,221 @@
 #include "Cocoa/Cocoa.h"
 #include "aerospace.h"
 #include "config.h"
+#include "config_watch.h"
 #import "event_tap.h"
+#include "gesture.h"
 #include "haptic.h"
+#include "input_filter.h"
+#include "latency.h"
+#include "log.h"
+#include "multitouch.h"
+#import "palm_tracker.h"
+#include "recording.h"
+#import "touch_ring.h"
 #include <AppKit/AppKit.h>
 #import <ApplicationServices/ApplicationServices.h>
-#include <pthread.h>
+
+// Backstop for the accessibility change notification
+#define AX_TRUST_POLL_SECS 5
+
+// How long a replaced settings snapshot stays readable by readers that do
+// not retain it. Those only hold one for a frame or a client callback, or
+// between loading it and retaining it.
+#define SETTINGS_RETIRE_SECS 10
 
 static aerospace* g_aerospace = NULL;
-static CFTypeRef g_haptic = NULL;
-static Config g_config;
-static pthread_mutex_t g_gesture_mutex = PTHREAD_MUTEX_INITIALIZER;
-static gesture_ctx g_gesture_ctx = { 0 };
-static CFMutableDictionaryRef g_tracks = NULL;
+static dispatch_queue_t g_aerospace_queue = NULL;
+static _Atomic unsigned g_arm_generation = 0;
+static _Atomic bool g_prefetch_queued = false;
+static touch_ring g_touch_ring = { 0 };
+static dispatch_queue_t g_gesture_queue = NULL;
+static dispatch_source_t g_frame_source = NULL;
+static _Atomic uint64_t g_frame_wakeups = 0;
+static _Atomic uint64_t g_frame_batched = 0;
+static _Atomic uint64_t g_frame_coalesced = 0;
+static dispatch_source_t g_stats_source = NULL;
+static bool g_switch_in_flight = false; // client queue only
+static int g_deferred_steps = 0; // client queue only
+static uint64_t g_switch_touched = 0, g_switch_fired = 0; // client queue only, latency_now() domain
+static uint64_t g_deferred_touched = 0, g_deferred_fired = 0; // earliest fire behind the switch in flight
+static char g_switch_target[WORKSPACE_NAME_MAX]; // client queue only, name the switch in flight goes to
+static _Atomic uint64_t g_switches_sent = 0;
+static _Atomic uint64_t g_steps_coalesced = 0;
+static input_filter g_input_filter = { 0 }; // input thread only, apart from counters
+static _Atomic bool g_gesture_busy = false; // gesture not idle, written by the gesture queue
+static _Atomic(recording*) g_recording = NULL; // --record, written on the input thread
+static dispatch_queue_t g_recording_queue = NULL; // grows and closes g_recording
+static _Atomic bool g_recording_growing = false;
 static BOOL g_enabled = YES;
+static _Atomic bool g_ax_trusted = false; // see start_ax_trust_monitor()
+static dispatch_source_t g_ax_timer = NULL;
+static bool g_tap_waiting = false; // event tap deferred until accessibility is granted, main thread only
+static bool g_ax_prompted = false; // main thread only
+static char g_config_path[512]; // watched for changes
+static dispatch_queue_t g_setup_queue = NULL; // startup work that input does not wait for, serial
+static uint64_t g_launched = 0; // latency_now() on entering main()
+
+typedef enum {
+	BINDING_NONE,
+	BINDING_WORKSPACE,
+	BINDING_COMMAND
+} binding_kind;
+
+typedef struct settings settings;
+
+// One cell of the dispatch table, by finger count and direction.
+typedef struct {
+	binding_kind kind;
+	int steps; // BINDING_WORKSPACE: +1 next, -1 prev
+	aerospace_request request; // BINDING_COMMAND
+	char name[BINDING_ARG_LEN]; // for logging
+	settings* owner; // retained for each command in flight
+} binding_entry;
+
+// The config in effect and the binding table compiled from it. Never
+// modified once published, apart from refs: changes publish a new snapshot,
+// so every thread reads one consistent version without a lock.
+struct settings {
+	Config config;
+	binding_entry bindings[BINDING_FINGERS][SWIPE_DIRECTIONS];
+	_Atomic int refs; // while published, plus one per binding command in flight
+};
+
+static _Atomic(settings*) g_settings = NULL; // written on the main thread only
+
+static const settings* current_settings(void)
+{
+	return atomic_load_explicit(&g_settings, memory_order_acquire);
+}
+
+static const Config* current_config(void)
+{
+	return &current_settings()->config;
+}
+
+// For readers that keep a snapshot longer than a frame: a binding command
+// awaiting its reply, and the gesture contexts.
+static void settings_retain(settings* s)
+{
+	atomic_fetch_add_explicit(&s->refs, 1, memory_order_relaxed);
+}
+
+static void settings_release(void* context)
+{
+	settings* s = context;
+	if (atomic_fetch_sub_explicit(&s->refs, 1, memory_order_acq_rel) == 1)
+		free(s);
+}
+
+// Gesture, palm and haptic state of one trackpad, so touches on two pads
+// never mix. The event tap cannot tell pads apart and only uses g_pads[0].
+typedef struct {
+	uint64_t device_id; // Multitouch ID, 0 for the default pad
+	gesture_ctx gesture; // gesture queue only
+	palm_tracker palms; // input thread only
+	haptic_channel haptic; // set up on g_setup_queue...
+	_Atomic bool haptic_ready; // ...and published by this
+} pad;
+
+static pad g_pads[MT_MAX_DEVICES];
+static int g_pad_count = 0; // fixed before input starts
+
+// Setup queue only. Opens the actuator of every pad that has none yet.
+// Returns false if no pad has one.
+static bool open_haptics(void)
+{
+	bool any = false;
+	for (int i = 0; i < g_pad_count; ++i) {
+		pad* p = &g_pads[i];
+		if (!atomic_load_explicit(&p->haptic_ready, memory_order_relaxed)) {
+			CFTypeRef actuator = p->device_id ? haptic_open(p->device_id) : haptic_open_default();
+			if (actuator && haptic_channel_init(&p->haptic, actuator, 3))
+				atomic_store_explicit(&p->haptic_ready, true, memory_order_release);
+			else if (actuator)
+				haptic_close(actuator);
+		}
+		any |= atomic_load_explicit(&p->haptic_ready, memory_order_relaxed);
+	}
+	return any;
+}
+
+// Walking IOKit for actuators takes milliseconds, so it happens behind
+// input starting; a swipe until then is simply not felt.
+static void open_haptics_async(void)
+{
+	dispatch_async(g_setup_queue, ^{
+		uint64_t start = latency_now();
+		if (open_haptics())
+			log_info("Haptics ready in %.1fms.\n", (latency_now() - start) / 1e6);
+		else
+			log_warn("Warning: Failed to initialize haptic actuator. Continuing without haptics.\n");
+	});
+}
+
+// Plays on the pad that was swiped the moment the swipe commits, off the
+// gesture queue. A scrub or fling that fires several times in a row is
+// felt once.
+static void play_haptic(pad* p, const Config* config)
+{
+	if (config->haptic && atomic_load_explicit(&p->haptic_ready, memory_order_acquire))
+		haptic_channel_play(&p->haptic);
+}
+
+// Turns config.bindings into the dispatch table once, so a fire is an index
+// and a pre-serialized request. `workspace next|prev` keeps the workspace
+// switch path (model lookup, skip_empty, coalescing).
+static void compile_bindings(settings* next)
+{
+	const Config* config = &next->config;
+	for (int i = 0; i < config->binding_count; ++i) {
+		const binding_config* binding = &config->bindings[i];
+		binding_entry* entry = &next->bindings[binding->fingers][binding->direction];
+
+		if (binding->arg_count == 2 && strcmp(binding->args[0], "workspace") == 0
+			&& (strcmp(binding->args[1], "next") == 0 || strcmp(binding->args[1], "prev") == 0)) {
+			entry->kind = BINDING_WORKSPACE;
+			entry->steps = strcmp(binding->args[1], "next") == 0 ? 1 : -1;
+			continue;
+		}
+
+		const char* args[BINDING_ARGS_MAX];
+		for (int arg = 0; arg < binding->arg_count; ++arg)
+			args[arg] = binding->args[arg];
+		if (!aerospace_request_init(&entry->request, args, binding->arg_count, NULL)) {
+			log_warn("Ignoring binding '%s': command too long.\n", binding->args[0]);
+			entry->kind = BINDING_NONE;
+			continue;
+		}
+		entry->kind = BINDING_COMMAND;
+		entry->owner = next;
+		snprintf(entry->name, sizeof(entry->name), "%s", binding->args[0]);
+	}
+}
+
+// Main thread. Replaces the settings in effect with `config`. The old
+// snapshot is freed once no reader can still be using it.
+static void settings_publish(const Config* config)
+{
+	settings* next = calloc(1, sizeof(*next));
+	if (!next) {
+		log_error("Error: Out of memory applying config.\n");
+		return;
+	}
+	next->config = *config;
+	next->refs = 1;
+	compile_bindings(next);
+
+	settings* old = atomic_exchange_explicit(&g_settings, next, memory_order_acq_rel);
+	bool haptic_was_on = old && old->config.haptic;
+	if (old)
+		dispatch_after_f(dispatch_time(DISPATCH_TIME_NOW, SETTINGS_RETIRE_SECS * NSEC_PER_SEC),
+			dispatch_get_global_queue(QOS_CLASS_UTILITY, 0), old, settings_release);
+
+	log_set_level(config->log_level);
+	touch_converter_set_filter(config->velocity_min_cutoff, config->velocity_beta);
+	if (config->haptic && !haptic_was_on && g_pad_count)
+		open_haptics_async();
+}
 
 // Menu bar app delegate
 @interface AppDelegate : NSObject <NSApplicationDelegate> {
@@ -27,17 +229,13 @@ static BOOL g_enabled = YES;
 @property (strong, nonatomic) NSMenuItem *naturalSwipeMenuItem;
 @property (strong, nonatomic) NSMenuItem *wrapAroundMenuItem;
 @property (strong, nonatomic) NSMenuItem *skipEmptyMenuItem;
+- (void)refreshMenuState;
 @end
 
 @implementation AppDelegate
 
+// Only created with the menu bar shown; otherwise there is no NSApplication.
 - (void)applicationDidFinishLaunching:(NSNotification *)notification {
-    // Skip menu bar if disabled in config
-    if (!g_config.show_menu_bar) {
-        NSLog(@"Menu bar disabled in config");
-        return;
-    }
-
     // Create status bar item
     self.statusItem = [[NSStatusBar systemStatusBar] statusItemWithLength:NSVariableStatusItemLength];
 
@@ -70,7 +268,6 @@ static BOOL g_enabled = YES;
         NSMenuItem *item = [[NSMenuItem alloc] initWithTitle:sensitivityLabels[i] action:@selector(setSensitivity:) keyEquivalent:@""];
         item.target = self;
         item.tag = i + 1;
-        item.state = (g_config.sensitivity == i + 1) ? NSControlStateValueOn : NSControlStateValueOff;
         [sensitivityMenu addItem:item];
         _sensitivityItems[i] = item;
     }
@@ -85,7 +282,6 @@ static BOOL g_enabled = YES;
         NSMenuItem *item = [[NSMenuItem alloc] initWithTitle:[NSString stringWithFormat:@"%d fingers", fingers] action:@selector(setFingers:) keyEquivalent:@""];
         item.target = self;
         item.tag = fingers;
-        item.state = (g_config.fingers == fingers) ? NSControlStateValueOn : NSControlStateValueOff;
         [fingersMenu addItem:item];
         _fingerItems[i] = item;
     }
@@ -97,22 +293,18 @@ static BOOL g_enabled = YES;
     // Toggle options
     self.hapticMenuItem = [[NSMenuItem alloc] initWithTitle:@"Haptic Feedback" action:@selector(toggleHaptic:) keyEquivalent:@""];
     self.hapticMenuItem.target = self;
-    self.hapticMenuItem.state = g_config.haptic ? NSControlStateValueOn : NSControlStateValueOff;
     [menu addItem:self.hapticMenuItem];
 
     self.naturalSwipeMenuItem = [[NSMenuItem alloc] initWithTitle:@"Natural Swipe" action:@selector(toggleNaturalSwipe:) keyEquivalent:@""];
     self.naturalSwipeMenuItem.target = self;
-    self.naturalSwipeMenuItem.state = g_config.natural_swipe ? NSControlStateValueOn : NSControlStateValueOff;
     [menu addItem:self.naturalSwipeMenuItem];
 
     self.wrapAroundMenuItem = [[NSMenuItem alloc] initWithTitle:@"Wrap Around" action:@selector(toggleWrapAround:) keyEquivalent:@""];
     self.wrapAroundMenuItem.target = self;
-    self.wrapAroundMenuItem.state = g_config.wrap_around ? NSControlStateValueOn : NSControlStateValueOff;
     [menu addItem:self.wrapAroundMenuItem];
 
     self.skipEmptyMenuItem = [[NSMenuItem alloc] initWithTitle:@"Skip Empty" action:@selector(toggleSkipEmpty:) keyEquivalent:@""];
     self.skipEmptyMenuItem.target = self;
-    self.skipEmptyMenuItem.state = g_config.skip_empty ? NSControlStateValueOn : NSControlStateValueOff;
     [menu addItem:self.skipEmptyMenuItem];
 
     [menu addItem:[NSMenuItem separatorItem]];
@@ -123,6 +315,22 @@ static BOOL g_enabled = YES;
     [menu addItem:quitItem];
 
     self.statusItem.menu = menu;
+    [self refreshMenuState];
+    log_info("Menu bar ready %.1fms after launch.\n", (latency_now() - g_launched) / 1e6);
+}
+
+// Checkmarks follow the settings in effect, which a config reload can
+// change as well as the menu.
+- (void)refreshMenuState {
+    const Config *config = current_config();
+    for (int i = 0; i < 3; i++) {
+        _sensitivityItems[i].state = (config->sensitivity == i + 1) ? NSControlStateValueOn : NSControlStateValueOff;
+        _fingerItems[i].state = (_fingerItems[i].tag == config->fingers) ? NSControlStateValueOn : NSControlStateValueOff;
+    }
+    self.hapticMenuItem.state = config->haptic ? NSControlStateValueOn : NSControlStateValueOff;
+    self.naturalSwipeMenuItem.state = config->natural_swipe ? NSControlStateValueOn : NSControlStateValueOff;
+    self.wrapAroundMenuItem.state = config->wrap_around ? NSControlStateValueOn : NSControlStateValueOff;
+    self.skipEmptyMenuItem.state = config->skip_empty ? NSControlStateValueOn : NSControlStateValueOff;
 }
 
 - (void)toggleEnabled:(id)sender {
@@ -136,72 +344,69 @@ static BOOL g_enabled = YES;
         self.statusItem.button.image = icon;
     }
 
-    NSLog(@"AeroSpace Swipe %@", g_enabled ? @"enabled" : @"disabled");
+    log_info("AeroSpace Swipe %s\n", g_enabled ? "enabled" : "disabled");
 }
 
 - (void)setSensitivity:(NSMenuItem *)sender {
     int level = (int)sender.tag;
-    apply_sensitivity(&g_config, level);
+    Config config = *current_config();
+    apply_sensitivity(&config, level);
+    settings_publish(&config);
+    [self refreshMenuState];
 
-    // Update checkmarks (1=Low, 2=Medium, 3=High)
-    for (int i = 0; i < 3; i++) {
-        _sensitivityItems[i].state = (i + 1 == level) ? NSControlStateValueOn : NSControlStateValueOff;
-    }
-
-    NSLog(@"Sensitivity set to %d (distance=%.2f, fast=%.2fx@vel%.2f)",
-          level, g_config.distance_pct, g_config.fast_distance_factor, g_config.fast_velocity_threshold);
+    log_info("Sensitivity set to %d (distance=%.2f, fast=%.2fx@vel%.2f)\n",
+          level, config.distance_pct, config.fast_distance_factor, config.fast_velocity_threshold);
 }
 
 - (void)setFingers:(NSMenuItem *)sender {
     int fingers = (int)sender.tag;
-    g_config.fingers = fingers;
+    Config config = *current_config();
+    config.fingers = fingers;
+    settings_publish(&config);
+    [self refreshMenuState];
 
-    // Update checkmarks
-    for (int i = 0; i < 3; i++) {
-        _fingerItems[i].state = (_fingerItems[i].tag == fingers) ? NSControlStateValueOn : NSControlStateValueOff;
-    }
-
-    NSLog(@"Fingers set to %d", fingers);
+    log_info("Fingers set to %d\n", fingers);
 }
 
 - (void)toggleHaptic:(id)sender {
-    g_config.haptic = !g_config.haptic;
-    self.hapticMenuItem.state = g_config.haptic ? NSControlStateValueOn : NSControlStateValueOff;
-
-    // Initialize haptic if enabling and not already initialized
-    if (g_config.haptic && !g_haptic) {
-        g_haptic = haptic_open_default();
-        if (!g_haptic) {
-            NSLog(@"Warning: Failed to initialize haptic actuator");
-        }
-    }
+    // Opens the actuators if they are not open yet
+    Config config = *current_config();
+    config.haptic = !config.haptic;
+    settings_publish(&config);
+    [self refreshMenuState];
 
-    NSLog(@"Haptic feedback %@", g_config.haptic ? @"enabled" : @"disabled");
+    log_info("Haptic feedback %s\n", config.haptic ? "enabled" : "disabled");
 }
 
 - (void)toggleNaturalSwipe:(id)sender {
-    g_config.natural_swipe = !g_config.natural_swipe;
-    self.naturalSwipeMenuItem.state = g_config.natural_swipe ? NSControlStateValueOn : NSControlStateValueOff;
+    Config config = *current_config();
+    config.natural_swipe = !config.natural_swipe;
 
     // Update swipe directions
-    g_config.swipe_left = g_config.natural_swipe ? "next" : "prev";
-    g_config.swipe_right = g_config.natural_swipe ? "prev" : "next";
+    config.swipe_left = config.natural_swipe ? "next" : "prev";
+    config.swipe_right = config.natural_swipe ? "prev" : "next";
+    settings_publish(&config);
+    [self refreshMenuState];
 
-    NSLog(@"Natural swipe %@", g_config.natural_swipe ? @"enabled" : @"disabled");
+    log_info("Natural swipe %s\n", config.natural_swipe ? "enabled" : "disabled");
 }
 
 - (void)toggleWrapAround:(id)sender {
-    g_config.wrap_around = !g_config.wrap_around;
-    self.wrapAroundMenuItem.state = g_config.wrap_around ? NSControlStateValueOn : NSControlStateValueOff;
+    Config config = *current_config();
+    config.wrap_around = !config.wrap_around;
+    settings_publish(&config);
+    [self refreshMenuState];
 
-    NSLog(@"Wrap around %@", g_config.wrap_around ? @"enabled" : @"disabled");
+    log_info("Wrap around %s\n", config.wrap_around ? "enabled" : "disabled");
 }
 
 - (void)toggleSkipEmpty:(id)sender {
-    g_config.skip_empty = !g_config.skip_empty;
-    self.skipEmptyMenuItem.state = g_config.skip_empty ? NSControlStateValueOn : NSControlStateValueOff;
+    Config config = *current_config();
+    config.skip_empty = !config.skip_empty;
+    settings_publish(&config);
+    [self refreshMenuState];
 
-    NSLog(@"Skip empty %@", g_config.skip_empty ? @"enabled" : @"disabled");
+    log_info("Skip empty %s\n", config.skip_empty ? "enabled" : "disabled");
 }
 
 - (void)quit:(id)sender {
@@ -210,291 +415,661 @@ static BOOL g_enabled = YES;
 
 @end
 
-static void switch_workspace(const char* ws)
+static void switch_workspace(int steps, uint64_t touched, uint64_t fired);
+
+// Ends the switch in flight and sends whatever steps piled up behind it as
+// one combined jump, timed from the first of the swipes it combines.
+static void finish_switch(void)
 {
-	// Ensure socket is alive; reconnect if broken or stale
-	if (!aerospace_ensure_connected(g_aerospace)) {
-		fprintf(stderr, "Error: Not connected to AeroSpace, will retry next swipe.\n");
-		return;
-	}
+	os_signpost_interval_end(g_latency_log, OS_SIGNPOST_ID_EXCLUSIVE, "switch");
+	g_switch_in_flight = false;
+	int steps = g_deferred_steps;
+	uint64_t touched = g_deferred_touched, fired = g_deferred_fired;
+	g_deferred_steps = 0;
+	if (steps)
+		switch_workspace(steps, touched, fired);
+}
 
-	if (g_config.skip_empty || g_config.wrap_around) {
-		char* workspaces = aerospace_list_workspaces(g_aerospace, !g_config.skip_empty);
-		if (!workspaces) {
-			fprintf(stderr, "Error: Unable to retrieve workspace list.\n");
-			return;
-		}
-		char* result = aerospace_workspace(g_aerospace, g_config.wrap_around, ws, workspaces);
-		if (result) {
-			fprintf(stderr, "Error: Failed to switch workspace to '%s'.\n", ws);
-		} else {
-			printf("Switched workspace successfully to '%s'.\n", ws);
-		}
-		free(workspaces);
-		free(result);
+static void on_workspace_switched(void* context, __unused uint64_t request_id, int exit_code, const char* output)
+{
+	const char* ws = context ? context : "target";
+	if (exit_code == 0) {
+		latency_record(LATENCY_SWITCH, g_switch_touched, latency_now());
+		log_info("Switched workspace successfully to '%s'.\n", ws);
 	} else {
-		char* result = aerospace_switch(g_aerospace, ws);
-		if (result) {
-			fprintf(stderr, "Error: Failed to switch workspace: '%s'\n", result);
-		} else {
-			printf("Switched workspace successfully to '%s'.\n", ws);
-		}
-		free(result);
+		// The optimistic focus update no longer holds
+		aerospace_invalidate_workspaces(g_aerospace);
+		if (exit_code == AEROSPACE_EXIT_TRANSPORT)
+			log_error("Error: No response from AeroSpace switching to '%s'.\n", ws);
+		else
+			log_error("Error: Failed to switch workspace: '%s'\n", output ? output : ws);
 	}
 
-	if (g_config.haptic && g_haptic)
-		haptic_actuate(g_haptic, 3);
+	finish_switch();
 }
 
-static void reset_gesture_state(gesture_ctx* ctx)
+// Lets AeroSpace resolve next/prev itself, which walks its own workspace
+// list rather than the model. One command per step, pipelined; the last
+// reply completes the switch.
+static void switch_relative(int steps, bool wrap_around)
 {
-	ctx->state = GS_IDLE;
-	ctx->last_fire_dir = 0;
+	const char* ws = steps > 0 ? "next" : "prev";
+	int count = abs(steps);
+	for (int i = 0; i < count; ++i) {
+		bool last = i == count - 1;
+		if (!aerospace_workspace_async(g_aerospace, wrap_around, ws, "", last ? on_workspace_switched : NULL,
+				(void*)ws)) {
+			log_error("Error: Failed to switch workspace to '%s'.\n", ws);
+			finish_switch();
+			return;
+		}
+	}
+	latency_record(LATENCY_WRITE, g_switch_fired, latency_now());
 }
 
-static void fire_gesture(gesture_ctx* ctx, int direction)
+static void on_workspace_model(void* context, const workspace_model* model)
 {
-	if (direction == ctx->last_fire_dir)
+	int steps = (int)(intptr_t)context;
+
+	if (!model) {
+		log_error("Error: Unable to retrieve workspace list, sending '%s'.\n", steps > 0 ? "next" : "prev");
+		switch_relative(steps, current_config()->wrap_around);
 		return;
+	}
 
-	ctx->last_fire_dir = direction;
-	ctx->state = GS_COMMITTED;
+	const Config* config = current_config();
+	int target = workspace_model_target(model, steps, config->skip_empty, config->wrap_around);
+	if (target < 0) {
+		finish_switch();
+		return;
+	}
 
-	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
-		switch_workspace(direction > 0 ? g_config.swipe_right : g_config.swipe_left);
-	});
+	// The model is only valid during this call; one switch is in flight at a time
+	snprintf(g_switch_target, sizeof(g_switch_target), "%s", model->names[target]);
+	log_info("Switching to workspace '%s'.\n", g_switch_target);
+	if (!aerospace_workspace_async(g_aerospace, 0, g_switch_target, "", on_workspace_switched, g_switch_target)) {
+		log_error("Error: Failed to switch workspace to '%s'.\n", model->names[target]);
+		finish_switch();
+		return;
+	}
+	latency_record(LATENCY_WRITE, g_switch_fired, latency_now());
+	aerospace_set_focused_workspace(g_aerospace, target);
 }
 
-static void calculate_touch_averages(touch* touches, int count,
-	float* avg_x, float* avg_y, float* avg_vel,
-	float* min_x, float* max_x, float* min_y, float* max_y)
+// Runs on the client queue and returns as soon as the command is written;
+// the rest of the switch completes from the client's callbacks. With
+// skip_empty or wrap_around the target is resolved from the cached
+// workspace model, so AeroSpace only sees a direct `workspace <name>`,
+// however many steps it spans; with neither, AeroSpace's own `workspace
+// next|prev` is kept, as it is what that configuration has always done.
+// Steps requested
+// while a switch is still in flight are summed and sent once it completes,
+// so back-to-back swipes or a scrub cost one round trip per reply, not per
+// step.
+static void switch_workspace(int steps, uint64_t touched, uint64_t fired)
 {
-	*avg_x = *avg_y = *avg_vel = 0;
-	*min_x = *min_y = 1;
-	*max_x = *max_y = 0;
+	if (g_switch_in_flight) {
+		if (!g_deferred_steps) {
+			g_deferred_touched = touched;
+			g_deferred_fired = fired;
+		}
+		g_deferred_steps += steps;
+		atomic_fetch_add_explicit(&g_steps_coalesced, 1, memory_order_relaxed);
+		return;
+	}
 
-	for (int i = 0; i < count; ++i) {
-		*avg_x += touches[i].x;
-		*avg_y += touches[i].y;
-		*avg_vel += touches[i].velocity;
+	// Normally a no-op: dropped sockets are reconnected in the background
+	if (!aerospace_ensure_connected(g_aerospace)) {
+		log_error("Error: Not connected to AeroSpace, will retry next swipe.\n");
+		return;
+	}
 
-		if (touches[i].x < *min_x)
-			*min_x = touches[i].x;
-		if (touches[i].x > *max_x)
-			*max_x = touches[i].x;
-		if (touches[i].y < *min_y)
-			*min_y = touches[i].y;
-		if (touches[i].y > *max_y)
-			*max_y = touches[i].y;
+	g_switch_in_flight = true;
+	g_switch_touched = touched;
+	g_switch_fired = fired;
+	atomic_fetch_add_explicit(&g_switches_sent, 1, memory_order_relaxed);
+	os_signpost_interval_begin(g_latency_log, OS_SIGNPOST_ID_EXCLUSIVE, "switch", "steps=%d", steps);
+	const Config* config = current_config();
+	if (!config->skip_empty && !config->wrap_around) {
+		switch_relative(steps, false);
+		return;
 	}
+	if (!aerospace_workspace_model_async(g_aerospace, on_workspace_model, (void*)(intptr_t)steps))
+		on_workspace_model((void*)(intptr_t)steps, NULL);
+}
 
-	*avg_x /= count;
-	*avg_y /= count;
-	*avg_vel /= count;
+static void queue_switch(int steps, uint64_t touched, uint64_t fired)
+{
+	os_signpost_event_emit(g_latency_log, OS_SIGNPOST_ID_EXCLUSIVE, "fire", "steps=%d", steps);
+	dispatch_async(g_aerospace_queue, ^{
+		switch_workspace(steps, touched, fired);
+	});
 }
 
-static bool handle_committed_state(gesture_ctx* ctx, touch* touches, int count)
+static void on_binding_done(void* context, __unused uint64_t request_id, int exit_code, const char* output)
 {
-	bool all_ended = true;
-	for (int i = 0; i < count; ++i) {
-		if (touches[i].phase != END_PHASE) {
-			all_ended = false;
+	const binding_entry* entry = context;
+	if (exit_code == 0) {
+		// The command may have moved windows or focus behind the cache
+		aerospace_invalidate_workspaces(g_aerospace);
+		log_info("Ran '%s' successfully.\n", entry->name);
+	} else if (exit_code == AEROSPACE_EXIT_TRANSPORT) {
+		log_error("Error: No response from AeroSpace running '%s'.\n", entry->name);
+	} else {
+		log_error("Error: Failed to run '%s': '%s'\n", entry->name, output ? output : "");
+	}
+	settings_release(entry->owner);
+}
+
+// Client queue. Repeats are pipelined rather than waiting on each reply.
+// Each one sent holds a reference to the entry's snapshot until its reply;
+// the caller's own reference is released here.
+static void run_binding(const binding_entry* entry, int count, uint64_t fired)
+{
+	if (!aerospace_ensure_connected(g_aerospace)) {
+		log_error("Error: Not connected to AeroSpace, will retry next swipe.\n");
+		settings_release(entry->owner);
+		return;
+	}
+
+	int sent = 0;
+	for (; sent < count; ++sent) {
+		settings_retain(entry->owner);
+		if (!aerospace_send_async(g_aerospace, &entry->request, "", on_binding_done, (void*)entry)) {
+			log_error("Error: Failed to run '%s'.\n", entry->name);
+			settings_release(entry->owner);
 			break;
 		}
 	}
+	if (sent == count)
+		latency_record(LATENCY_WRITE, fired, latency_now());
+	settings_release(entry->owner);
+}
 
-	if (!count || all_ended) {
-		reset_gesture_state(ctx);
-		return true;
+// Fire hook. A bound finger count and direction wins; otherwise it is the
+// built-in horizontal swipe for config.fingers. count is in workspaces, or
+// repeats of a command.
+static void on_gesture_fire(void* context, int fingers, swipe_direction direction, int count, double timestamp)
+{
+	pad* origin = context;
+	uint64_t touched = latency_from_seconds(timestamp);
+	uint64_t fired = latency_now();
+	latency_record(LATENCY_FIRE, touched, fired);
+
+	const settings* current = current_settings();
+	const Config* config = &current->config;
+	const binding_entry* entry = &current->bindings[fingers][direction];
+	switch (entry->kind) {
+		case BINDING_WORKSPACE:
+			queue_switch(entry->steps * count, touched, fired);
+			play_haptic(origin, config);
+			return;
+		case BINDING_COMMAND:
+			os_signpost_event_emit(g_latency_log, OS_SIGNPOST_ID_EXCLUSIVE, "fire", "command=%s", entry->name);
+			settings_retain(entry->owner);
+			dispatch_async(g_aerospace_queue, ^{
+				run_binding(entry, count, fired);
+			});
+			play_haptic(origin, config);
+			return;
+		case BINDING_NONE:
+			break;
 	}
 
-	float avg_x, avg_y, avg_vel, min_x, max_x, min_y, max_y;
-	calculate_touch_averages(touches, count, &avg_x, &avg_y, &avg_vel,
-		&min_x, &max_x, &min_y, &max_y);
+	if (fingers != config->fingers || (direction != SWIPE_LEFT && direction != SWIPE_RIGHT))
+		return;
+	const char* ws = direction == SWIPE_RIGHT ? config->swipe_right : config->swipe_left;
+	queue_switch((strcmp(ws, "next") == 0 ? 1 : -1) * count, touched, fired);
+	play_haptic(origin, config);
+}
 
-	float dx = avg_x - ctx->start_x;
-	if ((dx * ctx->last_fire_dir) < 0 && fabsf(dx) >= g_config.min_travel) {
-		ctx->state = GS_ARMED;
-		ctx->start_x = avg_x;
-		ctx->start_y = avg_y;
-		ctx->peak_velx = avg_vel;
-		ctx->dir = (avg_vel >= 0) ? 1 : -1;
+// The fingers still have to travel to distance_pct, so warm the socket and
+// fetch the workspace list now; the commit then only needs the final
+// `workspace` round trip. Re-arming while a prefetch is still queued does
+// not queue another one in front of the commit.
+static void on_gesture_armed(__unused void* context, __unused double timestamp)
+{
+	atomic_fetch_add_explicit(&g_arm_generation, 1, memory_order_relaxed);
+	if (atomic_exchange(&g_prefetch_queued, true))
+		return;
 
-		for (int i = 0; i < count; ++i)
-			ctx->base_x[i] = touches[i].x;
-	}
+	// Without skip_empty or wrap_around the switch never needs the model
+	const Config* config = current_config();
+	bool model = config->skip_empty || config->wrap_around;
+	dispatch_async(g_aerospace_queue, ^{
+		if (aerospace_ensure_connected(g_aerospace) && model)
+			aerospace_prefetch_workspaces(g_aerospace);
+		atomic_store(&g_prefetch_queued, false);
+	});
+}
 
-	return true;
+// An armed gesture that never committed: whatever it prefetched is dropped,
+// unless another gesture has armed since and may still use it. Queued behind
+// the prefetch, so it can never be overtaken by it.
+static void on_gesture_abandoned(__unused void* context, __unused double timestamp)
+{
+	unsigned generation = atomic_load_explicit(&g_arm_generation, memory_order_relaxed);
+	dispatch_async(g_aerospace_queue, ^{
+		if (atomic_load_explicit(&g_arm_generation, memory_order_relaxed) == generation)
+			aerospace_invalidate_workspaces(g_aerospace);
+	});
 }
 
-static void handle_idle_state(gesture_ctx* ctx, touch* touches, int count,
-	float avg_x, float avg_y, float avg_vel)
+// Gesture queue only. The snapshot every pad's gesture reads its config
+// from, retained: without frames it may be held for any length of time.
+static settings* g_gesture_settings = NULL;
+
+static void follow_settings(void)
 {
-	bool fast = fabsf(avg_vel) >= g_config.velocity_pct * FAST_VEL_FACTOR;
-	float need = fast ? g_config.min_travel_fast : g_config.min_travel;
+	settings* current = atomic_load_explicit(&g_settings, memory_order_acquire);
+	if (current == g_gesture_settings)
+		return;
 
-	// Count how many fingers have moved enough (allow some to lag)
-	int moved_count = 0;
-	for (int i = 0; i < count; ++i) {
-		if (fabsf(touches[i].x - ctx->base_x[i]) >= need)
-			moved_count++;
-	}
-	// At least half the fingers should have moved
-	bool moved = (moved_count >= (count + 1) / 2);
-
-	float dx = avg_x - ctx->start_x;
-	float dy = avg_y - ctx->start_y;
-
-	// Arm if moved and horizontal movement dominates
-	if (moved && (fast || fabsf(dx) >= ACTIVATE_PCT || fabsf(avg_vel) >= g_config.velocity_pct * 0.5f)) {
-		// Horizontal must be greater than vertical (original behavior)
-		if (fabsf(dx) > fabsf(dy) || fast) {
-			ctx->state = GS_ARMED;
-			ctx->start_x = avg_x;
-			ctx->start_y = avg_y;
-			ctx->peak_velx = avg_vel;
-			ctx->dir = (avg_vel >= 0) ? 1 : -1;
-		}
+	settings_retain(current);
+	for (int i = 0; i < g_pad_count; ++i)
+		gesture_set_config(&g_pads[i].gesture, &current->config);
+	if (g_gesture_settings)
+		settings_release(g_gesture_settings);
+	g_gesture_settings = current;
+}
+
+static void gestureCallback(const touch_frame* frame)
+{
+	if (!g_enabled)
+		return;
+
+	uint64_t dequeued = latency_now();
+	latency_record(LATENCY_DEQUEUE, frame->published, dequeued);
+	follow_settings();
+	gesture_ctx* ctx = &g_pads[frame->pad].gesture;
+	gesture_process(ctx, frame);
+	atomic_store_explicit(&g_gesture_busy, ctx->state != GS_IDLE, memory_order_relaxed);
+	latency_record(LATENCY_GESTURE, dequeued, latency_now());
+}
+
+// Runs on g_gesture_queue only. Wakeups that arrive while a drain is in
+// progress are merged by the data source, so one pass may see several
+// frames; those are counted as batched. With coalesce_frames, a backlog is
+// collapsed to its newest frame plus any transition frames in between.
+static void drain_touch_ring(void)
+{
+	uint64_t frames = 0;
+	touch_frame* frame;
+	while ((frame = touch_ring_peek(&g_touch_ring))) {
+		bool skip = false;
+		if (current_config()->coalesce_frames && touch_ring_pending(&g_touch_ring) > 1)
+			skip = !gesture_is_transition_frame(frame, touch_ring_at(&g_touch_ring, 1));
+
+		if (skip)
+			atomic_fetch_add_explicit(&g_frame_coalesced, 1, memory_order_relaxed);
+		else
+			gestureCallback(frame);
+
+		os_signpost_interval_end(g_latency_log, os_signpost_id_make_with_pointer(g_latency_log, frame), "frame");
+		touch_ring_release(&g_touch_ring);
+		frames++;
 	}
+
+	atomic_fetch_add_explicit(&g_frame_wakeups, 1, memory_order_relaxed);
+	if (frames > 1)
+		atomic_fetch_add_explicit(&g_frame_batched, frames - 1, memory_order_relaxed);
 }
 
-static void handle_armed_state(gesture_ctx* ctx, touch* touches, int count,
-	float avg_x, float avg_y, float avg_vel)
+// All gesture state is owned by one serial, user-interactive queue: frames
+// are consumed in capture order and gesture_ctx needs no lock.
+static void start_gesture_queue(void)
 {
-	float dx = avg_x - ctx->start_x;
-	float dy = avg_y - ctx->start_y;
+	dispatch_queue_attr_t attr = dispatch_queue_attr_make_with_qos_class(
+		DISPATCH_QUEUE_SERIAL, QOS_CLASS_USER_INTERACTIVE, 0);
+	g_gesture_queue = dispatch_queue_create("com.acsandmann.swipe.gesture", attr);
+
+	g_frame_source = dispatch_source_create(DISPATCH_SOURCE_TYPE_DATA_ADD, 0, 0, g_gesture_queue);
+	dispatch_source_set_event_handler(g_frame_source, ^{
+		drain_touch_ring();
+	});
+	dispatch_resume(g_frame_source);
+}
 
-	// Reset if vertical movement exceeds horizontal (with small tolerance for diagonal)
-	if (fabsf(dy) > fabsf(dx) * 1.2f) {
-		reset_gesture_state(ctx);
+static void add_pad(uint64_t device_id)
+{
+	if (g_pad_count >= MT_MAX_DEVICES)
 		return;
-	}
 
-	bool fast = fabsf(avg_vel) >= g_config.velocity_pct * FAST_VEL_FACTOR;
-	float stepReq = fast ? g_config.min_step_fast : g_config.min_step;
+	pad* p = &g_pads[g_pad_count++];
+	p->device_id = device_id;
+	gesture_hooks hooks = { on_gesture_armed, on_gesture_abandoned, on_gesture_fire, p };
+	gesture_init(&p->gesture, current_config(), &hooks);
+}
 
-	int mismatch_count = 0;
-	for (int i = 0; i < count; ++i) {
-		float ddx = touches[i].x - ctx->prev_x[i];
-		if (fabsf(ddx) < stepReq || (ddx * dx) < 0) {
-			mismatch_count++;
-			if (mismatch_count > g_config.swipe_tolerance) {
-				reset_gesture_state(ctx);
-				return;
-			}
-		}
+// One pad per multitouch device, so each runs its own state machine and
+// buzzes its own actuator. Must run before input starts: the input thread
+// and gesture queue read g_pads without a lock. If the event tap ends up
+// being used, its frames all go to the first pad. Actuators are opened
+// later, by open_haptics_async().
+static void open_pads(bool per_device)
+{
+	if (per_device) {
+		multitouch_iterate_devices(^(uint64_t id) {
+			add_pad(id);
+		});
 	}
+	if (!g_pad_count)
+		add_pad(0);
+}
 
-	if (fabsf(avg_vel) > fabsf(ctx->peak_velx)) {
-		ctx->peak_velx = avg_vel;
-		ctx->dir = (avg_vel >= 0) ? 1 : -1;
+// Unknown devices share the first pad.
+static int pad_for_device(uint64_t device_id)
+{
+	for (int i = 0; i < g_pad_count; ++i) {
+		if (g_pads[i].device_id == device_id)
+			return i;
 	}
+	return 0;
+}
 
-	// Fire based on distance
-	if (fabsf(dx) >= g_config.distance_pct) {
-		fire_gesture(ctx, dx > 0 ? 1 : -1);
-	}
-	// Or fire on fast intentional swipes (for medium/high sensitivity)
-	// Must reach at least fast_distance_factor of the threshold distance
-	else if (fabsf(avg_vel) >= g_config.fast_velocity_threshold &&
-	         fabsf(dx) >= g_config.distance_pct * g_config.fast_distance_factor) {
-		fire_gesture(ctx, dx > 0 ? 1 : -1);
-	}
+static void grow_recording(void* context)
+{
+	if (recording_grow(context))
+		atomic_store_explicit(&g_recording_growing, false, memory_order_relaxed);
+	else
+		log_warn("Warning: Could not grow the recording, frames past its end are dropped.\n");
 }
 
-static void gestureCallback(touch* touches, int count)
+static void close_recording_on_queue(void* context)
 {
-	if (!g_enabled)
-		return;
+	recording_close(context);
+}
 
-	pthread_mutex_lock(&g_gesture_mutex);
+// Input thread. The file is grown on g_recording_queue well before it is
+// full, so appending never waits for the filesystem.
+static void record_frame(recording* rec, const touch_frame* frame)
+{
+	if (!recording_append(rec, frame)) {
+		log_error("Error: The recording is full, stopping it.\n");
+		atomic_store(&g_recording, NULL);
+		dispatch_async_f(g_recording_queue, rec, close_recording_on_queue);
+		return;
+	}
+	if (recording_wants_growth(rec) && !atomic_exchange_explicit(&g_recording_growing, true, memory_order_relaxed))
+		dispatch_async_f(g_recording_queue, rec, grow_recording);
+}
 
-	gesture_ctx* ctx = &g_gesture_ctx;
+// Runs on the input thread of whichever backend is active. Palms are
+// classified against every frame the hardware delivers, stationary contacts
+// included, and dropped here with them, so coalescing and the gesture states
+// only ever see moving fingers. `entered` is
+// when the backend callback started, for the latency histograms.
+static void publish_touches(int pad_index, touch* touches, int count, uint64_t entered)
+{
+	const Config* config = current_config();
+	palm_params params = { config->palm_disp, config->palm_age, config->palm_velocity };
+	count = palm_tracker_filter(&g_pads[pad_index].palms, touches, count, config_max_fingers(config), &params);
 
-	if (ctx->state == GS_COMMITTED) {
-		if (handle_committed_state(ctx, touches, count))
-			goto unlock;
-	}
+	touch_frame* frame = touch_ring_reserve(&g_touch_ring);
+	if (!frame)
+		return;
 
-	if (count != g_config.fingers) {
-		if (ctx->state == GS_ARMED)
-			ctx->state = GS_IDLE;
+	frame->count = 0;
+	frame->timestamp = 0;
+	frame->pad = pad_index;
+	for (int i = 0; i < count; ++i)
+		touch_frame_append(frame, &touches[i]);
+
+	recording* rec = atomic_load_explicit(&g_recording, memory_order_relaxed);
+	if (rec)
+		record_frame(rec, frame);
+
+	if (frame->count)
+		latency_record(LATENCY_INPUT, latency_from_seconds(frame->timestamp), entered);
+	frame->published = latency_now();
+	latency_record(LATENCY_PUBLISH, entered, frame->published);
+	os_signpost_interval_begin(g_latency_log, os_signpost_id_make_with_pointer(g_latency_log, frame), "frame",
+		"fingers=%d", frame->count);
+	touch_ring_commit(&g_touch_ring);
+
+	// Merging into a data source neither allocates nor queues a work item.
+	dispatch_source_merge_data(g_frame_source, 1);
+}
 
-		for (int i = 0; i < count; ++i)
-			ctx->prev_x[i] = ctx->base_x[i] = touches[i].x;
+static void process_touches(NSSet<NSTouch*>* touches, uint64_t entered)
+{
+	touch staged[MAX_TOUCHES];
+	int n = 0;
+	for (NSTouch* touch in touches) {
+		if (n >= MAX_TOUCHES)
+			break;
+		staged[n++] = [TouchConverter convert_nstouch:touch];
+	}
+	publish_touches(0, staged, n, entered);
+}
 
-		goto unlock;
+static int contact_phase(int state)
+{
+	switch (state) {
+		case MT_STATE_MAKE_TOUCH:
+			return NSTouchPhaseBegan;
+		case MT_STATE_TOUCHING:
+			return NSTouchPhaseMoved;
+		case MT_STATE_BREAK_TOUCH:
+		case MT_STATE_LINGER_IN_RANGE:
+			return END_PHASE;
+		default:
+			return 0; // hovering or out of range, not a touch
 	}
+}
 
-	float avg_x, avg_y, avg_vel, min_x, max_x, min_y, max_y;
-	calculate_touch_averages(touches, count, &avg_x, &avg_y, &avg_vel,
-		&min_x, &max_x, &min_y, &max_y);
+// MultitouchSupport backend: raw contacts already carry normalized position
+// and velocity, so they go straight into the ring without any ObjC.
+static void process_contacts(uint64_t device_id, const mt_contact* contacts, int count, double timestamp)
+{
+	uint64_t entered = latency_now();
+	if (!count)
+		return;
 
-	if (ctx->state == GS_IDLE) {
-		handle_idle_state(ctx, touches, count, avg_x, avg_y, avg_vel);
-	} else if (ctx->state == GS_ARMED) {
-		handle_armed_state(ctx, touches, count, avg_x, avg_y, avg_vel);
+	touch staged[MAX_TOUCHES];
+	int n = 0;
+	for (int i = 0; i < count && n < MAX_TOUCHES; ++i) {
+		int phase = contact_phase(contacts[i].state);
+		if (!phase)
+			continue;
+
+		touch* t = &staged[n++];
+		t->x = contacts[i].normalized.position.x;
+		t->y = contacts[i].normalized.position.y;
+		t->phase = phase;
+		t->timestamp = timestamp;
+		t->velocity = contacts[i].normalized.velocity.x;
+		t->velocity_y = contacts[i].normalized.velocity.y;
+		t->identity = (uint64_t)(uint32_t)contacts[i].identifier;
+		t->is_palm = false;
 	}
+	publish_touches(pad_for_device(device_id), staged, n, entered);
+}
 
-	for (int i = 0; i < count; ++i) {
-		ctx->prev_x[i] = touches[i].x;
-		if (ctx->state == GS_IDLE)
-			ctx->base_x[i] = touches[i].x;
+static void dump_stats(void)
+{
+	fprintf(stderr, "touch ring: pushed=%llu dropped=%llu high_water=%u/%d\n",
+		(unsigned long long)atomic_load(&g_touch_ring.pushed),
+		(unsigned long long)atomic_load(&g_touch_ring.dropped),
+		atomic_load(&g_touch_ring.high_water),
+		TOUCH_RING_CAPACITY);
+	fprintf(stderr, "gesture queue: wakeups=%llu batched=%llu coalesced=%llu\n",
+		(unsigned long long)atomic_load(&g_frame_wakeups),
+		(unsigned long long)atomic_load(&g_frame_batched),
+		(unsigned long long)atomic_load(&g_frame_coalesced));
+	fprintf(stderr, "input filter: by_subtype=%llu by_scroll=%llu by_count=%llu\n",
+		(unsigned long long)atomic_load(&g_input_filter.by_subtype),
+		(unsigned long long)atomic_load(&g_input_filter.by_scroll),
+		(unsigned long long)atomic_load(&g_input_filter.by_count));
+	uint64_t palms = 0, predicted = 0, mispredicted = 0;
+	for (int i = 0; i < g_pad_count; ++i) {
+		palms += atomic_load(&g_pads[i].palms.rejected);
+		predicted += atomic_load(&g_pads[i].gesture.predicted_commits);
+		mispredicted += atomic_load(&g_pads[i].gesture.mispredicted);
 	}
+	fprintf(stderr, "palms rejected: %llu (%d pads)\n", (unsigned long long)palms, g_pad_count);
+	fprintf(stderr, "prediction: commits=%llu mispredicted=%llu\n",
+		(unsigned long long)predicted, (unsigned long long)mispredicted);
+	fprintf(stderr, "switches: sent=%llu coalesced_steps=%llu\n",
+		(unsigned long long)atomic_load(&g_switches_sent),
+		(unsigned long long)atomic_load(&g_steps_coalesced));
+
+	aerospace_stats stats = { 0 };
+	aerospace_get_stats(g_aerospace, &stats);
+	fprintf(stderr, "workspace cache: hits=%lu misses=%lu events=%lu subscribed=%s\n",
+		stats.workspace_cache_hits, stats.workspace_cache_misses, stats.workspace_events,
+		stats.subscribed ? "yes" : "no");
+	fprintf(stderr, "aerospace: max_in_flight=%lu reconnects=%lu failed=%lu connect_ms=%.2f (max %.2f) last_outage_ms=%.1f\n",
+		stats.max_in_flight, stats.reconnects, stats.reconnect_failures,
+		stats.last_connect_ms, stats.max_connect_ms, stats.last_outage_ms);
+	latency_dump();
+}
 
-unlock:
-	pthread_mutex_unlock(&g_gesture_mutex);
+// `kill -USR1 <pid>` prints the pipeline counters to stderr.
+static void install_stats_handler(void)
+{
+	signal(SIGUSR1, SIG_IGN);
+	g_stats_source = dispatch_source_create(DISPATCH_SOURCE_TYPE_SIGNAL, SIGUSR1, 0,
+		dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_LOW, 0));
+	dispatch_source_set_event_handler(g_stats_source, ^{
+		dump_stats();
+	});
+	dispatch_resume(g_stats_source);
 }
 
-static void process_touches(NSSet<NSTouch*>* touches)
+static CGEventRef key_handler(CGEventTapProxy proxy, CGEventType type, CGEventRef event, void* ref);
+
+// Main thread. Without accessibility permission the tap cannot be created,
+// so it is left waiting (after prompting once) and the trust monitor calls
+// this again when the permission is granted; everything else is already
+// running, so nothing needs a relaunch.
+static void start_event_tap(void)
 {
-	NSUInteger buf_capacity = touches.count > 0 ? touches.count : 4;
-	touch* buf = malloc(sizeof(touch) * buf_capacity);
-	NSUInteger i = 0;
+	if (event_tap_enabled(&g_event_tap))
+		return;
 
-	for (NSTouch* touch in touches) {
-		if (touch.phase != (1 << 2)) {
-			if (i >= buf_capacity) {
-				buf_capacity *= 2;
-				buf = realloc(buf, sizeof(touch) * buf_capacity);
-			}
-			buf[i++] = [TouchConverter convert_nstouch:touch];
+	if (!atomic_load_explicit(&g_ax_trusted, memory_order_relaxed)) {
+		if (!g_ax_prompted) {
+			g_ax_prompted = true;
+			NSDictionary* options = @{(__bridge id)kAXTrustedCheckOptionPrompt : @YES};
+			AXIsProcessTrustedWithOptions((__bridge CFDictionaryRef)options);
+			log_warn("Accessibility permission not granted, swipes start once it is.\n");
 		}
+		g_tap_waiting = true;
+		return;
+	}
+
+	bool started;
+	if (current_config()->tap_thread)
+		started = event_tap_begin_on_thread(&g_event_tap, key_handler);
+	else
+		started = event_tap_begin(&g_event_tap, key_handler);
+	if (!started)
+		log_error("Error: Could not create the event tap.\n");
+	else if (g_tap_waiting)
+		log_info("Accessibility permission granted, event tap started.\n");
+	g_tap_waiting = !started;
+}
+
+// AXIsProcessTrusted() is a TCC round trip. The tap callback only reads the
+// cached answer, which is refreshed a moment after the accessibility
+// database reports a change (TCC applies it asynchronously) and polled as a
+// backstop, since that notification is undocumented.
+static void refresh_ax_trust(void)
+{
+	bool trusted = AXIsProcessTrusted();
+	bool was_trusted = atomic_exchange_explicit(&g_ax_trusted, trusted, memory_order_relaxed);
+	if (trusted && !was_trusted) {
+		dispatch_async(dispatch_get_main_queue(), ^{
+			if (g_tap_waiting)
+				start_event_tap();
+		});
 	}
+}
 
-	dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
-		gestureCallback(buf, (int)i);
-		free(buf);
+static void start_ax_trust_monitor(void)
+{
+	refresh_ax_trust();
+
+	dispatch_queue_t queue = dispatch_get_global_queue(QOS_CLASS_UTILITY, 0);
+	g_ax_timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, queue);
+	dispatch_source_set_timer(g_ax_timer, dispatch_time(DISPATCH_TIME_NOW, AX_TRUST_POLL_SECS * NSEC_PER_SEC),
+		AX_TRUST_POLL_SECS * NSEC_PER_SEC, NSEC_PER_SEC);
+	dispatch_source_set_event_handler(g_ax_timer, ^{
+		refresh_ax_trust();
 	});
+	dispatch_resume(g_ax_timer);
+
+	[[NSDistributedNotificationCenter defaultCenter] addObserverForName:@"com.apple.accessibility.api"
+		object:nil
+		queue:nil
+		usingBlock:^(__unused NSNotification* note) {
+			dispatch_after(dispatch_time(DISPATCH_TIME_NOW, NSEC_PER_SEC / 4), queue, ^{
+				refresh_ax_trust();
+			});
+		}];
 }
 
 static CGEventRef key_handler(__unused CGEventTapProxy proxy, CGEventType type,
 	CGEventRef event, void* ref)
 {
+	uint64_t entered = latency_now();
 	struct event_tap* event_tap_ref = (struct event_tap*)ref;
 
-	if (!AXIsProcessTrusted()) {
-		NSLog(@"Accessibility permission lost, disabling tap.");
+	if (!atomic_load_explicit(&g_ax_trusted, memory_order_relaxed)) {
+		log_warn("Accessibility permission lost, disabling tap until it is granted again.\n");
 		event_tap_end(event_tap_ref);
+		dispatch_async(dispatch_get_main_queue(), ^{
+			g_tap_waiting = true;
+			if (atomic_load_explicit(&g_ax_trusted, memory_order_relaxed))
+				start_event_tap(); // granted again before this ran
+		});
 		return event;
 	}
 
 	if (type == kCGEventTapDisabledByTimeout || type == kCGEventTapDisabledByUserInput) {
-		NSLog(@"Event-tap re-enabled.");
+		log_info("Event-tap re-enabled.\n");
 		CGEventTapEnable(event_tap_ref->handle, true);
 		return event;
 	}
 
+	if (type == kCGEventScrollWheel) {
+		int64_t phase = CGEventGetIntegerValueField(event, kCGScrollWheelEventScrollPhase);
+		if (phase)
+			input_filter_scroll_phase(&g_input_filter, phase == kCGScrollPhaseBegan || phase == kCGScrollPhaseChanged);
+		return event;
+	}
+
 	if (type != NSEventTypeGesture)
 		return event;
 
-	NSEvent* ev = [NSEvent eventWithCGEvent:event];
-	NSSet<NSTouch*>* touches = ev.allTouches;
+	bool busy = atomic_load_explicit(&g_gesture_busy, memory_order_relaxed);
+	int64_t subtype = CGEventGetIntegerValueField(event, CG_EVENT_GESTURE_HID_TYPE);
+	if (input_filter_skip_subtype(&g_input_filter, subtype, busy))
+		return event;
 
-	if (!touches.count)
+	int fingers = config_min_fingers(current_config());
+	if (input_filter_skip_scroll(&g_input_filter, fingers, busy))
 		return event;
 
-	process_touches(touches);
+	// The input thread's run loop does not drain a pool between events
+	@autoreleasepool {
+		NSEvent* ev = [NSEvent eventWithCGEvent:event];
+		NSSet<NSTouch*>* touches = ev.allTouches;
+		int count = (int)touches.count;
+		input_filter_learn(&g_input_filter, subtype, count);
+
+		bool ended = false;
+		if (count < fingers) {
+			for (NSTouch* touch in touches)
+				ended |= (touch.phase & (NSTouchPhaseEnded | NSTouchPhaseCancelled)) != 0;
+		}
+		if (input_filter_skip_count(&g_input_filter, count, ended, fingers, busy))
+			return event;
+
+		if (count)
+			process_touches(touches, entered);
+	}
 
 	return event;
 }
@@ -503,14 +1078,14 @@ static void acquire_lockfile(void)
 {
 	char* user = getenv("USER");
 	if (!user)
-		printf("Error: User variable not set.\n"), exit(1);
+		log_error("Error: User variable not set.\n"), exit(1);
 
 	char buffer[256];
 	snprintf(buffer, 256, "/tmp/aerospace-swipe-%s.lock", user);
 
 	int handle = open(buffer, O_CREAT | O_WRONLY, 0600);
 	if (handle == -1) {
-		printf("Error: Could not create lock-file.\n");
+		log_error("Error: Could not create lock-file.\n");
 		exit(1);
 	}
 
@@ -523,76 +1098,195 @@ static void acquire_lockfile(void)
 	};
 
 	if (fcntl(handle, F_SETLK, &lockfd) == -1) {
-		printf("Error: Could not acquire lock-file.\naerospace-swipe already running?\n");
+		log_error("Error: Could not acquire lock-file.\naerospace-swipe already running?\n");
 		exit(1);
 	}
 }
 
-void waitForAccessibilityAndRestart(void)
+// atexit. Input is stopped first, so nothing is still appending, and the
+// close queues behind any growth in progress.
+static void close_recording(void)
 {
-	while (!AXIsProcessTrusted()) {
-		NSLog(@"Waiting for accessibility permission...");
-		sleep(1);
+	event_tap_end(&g_event_tap);
+	multitouch_stop();
+
+	recording* rec = atomic_exchange(&g_recording, NULL);
+	if (rec)
+		dispatch_sync_f(g_recording_queue, rec, close_recording_on_queue);
+}
+
+// `--record <path>` writes every frame the gesture states see to `path`,
+// for the replay tool.
+static void start_recording(int argc, const char* argv[])
+{
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--record") != 0)
+			continue;
+		if (i + 1 >= argc) {
+			log_error("Error: --record needs a file name.\n");
+			exit(EXIT_FAILURE);
+		}
+
+		recording* rec = recording_create(argv[i + 1]);
+		if (!rec)
+			exit(EXIT_FAILURE);
+		g_recording_queue = dispatch_queue_create("com.acsandmann.swipe.recording",
+			dispatch_queue_attr_make_with_qos_class(DISPATCH_QUEUE_SERIAL, QOS_CLASS_UTILITY, 0));
+		atomic_store(&g_recording, rec);
+		atexit(close_recording);
+		log_info("Recording touch frames to: %s\n", argv[i + 1]);
+		return;
 	}
+}
 
-	NSLog(@"Accessibility permission granted. Restarting app...");
+// Config watch queue: parses off the main thread, applies on the main
+// thread like the menu does. A file that does not parse is ignored, so a
+// half-saved edit never resets the settings. Settings only read at startup
+// keep their current values.
+static void reload_config(__unused void* context)
+{
+	Config loaded;
+	if (!config_read_file(g_config_path, &loaded)) {
+		log_warn("Could not reload %s, keeping the current settings.\n", g_config_path);
+		return;
+	}
 
-	NSString* bundlePath = [[NSBundle mainBundle] bundlePath];
-	[[NSWorkspace sharedWorkspace] openApplicationAtURL:[NSURL fileURLWithPath:bundlePath] configuration:[NSWorkspaceOpenConfiguration configuration] completionHandler:nil];
-	exit(0);
+	dispatch_async(dispatch_get_main_queue(), ^{
+		Config config = loaded;
+		const Config* current = current_config();
+		config.input_backend = current->input_backend;
+		config.tap_thread = current->tap_thread;
+		config.show_menu_bar = current->show_menu_bar;
+		settings_publish(&config);
+		[(AppDelegate*)NSApp.delegate refreshMenuState];
+		log_info("Reloaded config from %s.\n", g_config_path);
+	});
 }
 
-int main(int argc, const char* argv[])
+static void start_config_watch(void)
 {
-	signal(SIGCHLD, SIG_IGN);
-	signal(SIGPIPE, SIG_IGN);
+	config_find_path(g_config_path, sizeof(g_config_path));
+	if (!config_watch_start(g_config_path, reload_config, NULL))
+		log_warn("Warning: Not watching %s for changes.\n", g_config_path);
+}
 
-	acquire_lockfile();
+// Main-thread startup phases, logged as one line once input is live.
+// Work moved off startup (AeroSpace, haptics, the menu) logs when it is done.
+#define STARTUP_PHASES_MAX 12
 
-	@autoreleasepool {
-		NSDictionary* options = @{(__bridge id)kAXTrustedCheckOptionPrompt : @YES};
+typedef struct {
+	const char* name;
+	uint64_t end; // latency_now()
+} startup_mark;
 
-		if (!AXIsProcessTrustedWithOptions((__bridge CFDictionaryRef)options)) {
-			NSLog(@"Accessibility permission not granted. Prompting user...");
-			AXIsProcessTrustedWithOptions((__bridge CFDictionaryRef)options);
+static startup_mark g_startup_phases[STARTUP_PHASES_MAX];
+static int g_startup_phase_count = 0;
 
-			dispatch_async(dispatch_get_global_queue(DISPATCH_QUEUE_PRIORITY_DEFAULT, 0), ^{
-				waitForAccessibilityAndRestart();
-			});
+static void startup_phase(const char* name)
+{
+	if (g_startup_phase_count < STARTUP_PHASES_MAX)
+		g_startup_phases[g_startup_phase_count++] = (startup_mark) { name, latency_now() };
+}
 
-			CFRunLoopRun();
-		}
+static void log_startup(void)
+{
+	char line[512];
+	size_t len = 0;
+	uint64_t from = g_launched;
+	for (int i = 0; i < g_startup_phase_count && len < sizeof(line); ++i) {
+		len += snprintf(line + len, sizeof(line) - len, "%s%s %.1fms", i ? ", " : "", g_startup_phases[i].name,
+			(g_startup_phases[i].end - from) / 1e6);
+		from = g_startup_phases[i].end;
+	}
+	log_info("Startup: %s (%.1fms total)\n", len ? line : "-", (from - g_launched) / 1e6);
+}
 
-		NSLog(@"Accessibility permission granted. Continuing app initialization...");
+static bool has_flag(int argc, const char* argv[], const char* flag)
+{
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], flag) == 0)
+			return true;
+	}
+	return false;
+}
+
+// Input goes live first; the AeroSpace connection, actuators and menu are
+// set up behind it. `--headless`, or show_menu_bar off, runs without an
+// NSApplication: the main run loop alone services the event tap, the main
+// queue (config reloads) and the accessibility notification.
+int main(int argc, const char* argv[])
+{
+	g_launched = latency_now();
+	signal(SIGCHLD, SIG_IGN);
+	signal(SIGPIPE, SIG_IGN);
+	latency_init();
 
-		g_config = load_config();
-		NSLog(@"Loaded config: fingers=%d, skip_empty=%s, wrap_around=%s, haptic=%s, swipe_left='%s', swipe_right='%s'",
-			g_config.fingers,
-			g_config.skip_empty ? "YES" : "NO",
-			g_config.wrap_around ? "YES" : "NO",
-			g_config.haptic ? "YES" : "NO",
-			g_config.swipe_left,
-			g_config.swipe_right);
+	acquire_lockfile();
+	startup_phase("lock");
 
+	@autoreleasepool {
+		g_setup_queue = dispatch_queue_create("com.acsandmann.swipe.setup",
+			dispatch_queue_attr_make_with_qos_class(DISPATCH_QUEUE_SERIAL, QOS_CLASS_UTILITY, 0));
+
+		Config config = load_config();
+		settings_publish(&config);
+		log_start(config.log_level);
+		log_info("Loaded config: fingers=%d, skip_empty=%s, wrap_around=%s, haptic=%s, swipe_left='%s', swipe_right='%s'\n",
+			config.fingers,
+			config.skip_empty ? "YES" : "NO",
+			config.wrap_around ? "YES" : "NO",
+			config.haptic ? "YES" : "NO",
+			config.swipe_left,
+			config.swipe_right);
+		bool headless = has_flag(argc, argv, "--headless") || !config.show_menu_bar;
+		startup_phase("config");
+
+		// Connects on its own queue. AeroSpace might not be running yet;
+		// dropped or missing connections are retried in the background.
 		g_aerospace = aerospace_new(NULL);
 		if (!g_aerospace) {
-			fprintf(stderr, "Error: Failed to allocate Aerospace client.\n");
+			log_error("Error: Failed to allocate Aerospace client.\n");
 			exit(EXIT_FAILURE);
 		}
-		// Socket may not connect yet (AeroSpace might not be running).
-		// That's fine - aerospace_ensure_connected() will retry on each swipe.
-
-		if (g_config.haptic) {
-			g_haptic = haptic_open_default();
-			if (!g_haptic)
-				fprintf(stderr, "Warning: Failed to initialize haptic actuator. Continuing without haptics.\n");
+		// Every socket operation runs on the client's own serial queue
+		g_aerospace_queue = aerospace_queue(g_aerospace);
+		dispatch_async(g_aerospace_queue, ^{
+			// Also opens the event stream, so the first swipe finds the model warm
+			bool connected = aerospace_ensure_connected(g_aerospace);
+			log_info("AeroSpace %s %.1fms after launch.\n", connected ? "connected" : "not reachable yet",
+				(latency_now() - g_launched) / 1e6);
+		});
+		startup_phase("client");
+
+		open_pads(config.input_backend == INPUT_BACKEND_MULTITOUCH);
+		startup_phase("pads");
+
+		install_stats_handler();
+		start_recording(argc, argv);
+		start_gesture_queue();
+		start_ax_trust_monitor();
+		startup_phase("queues");
+
+		bool input_started = false;
+		if (config.input_backend == INPUT_BACKEND_MULTITOUCH) {
+			input_started = multitouch_start(process_contacts);
+			if (!input_started)
+				log_warn("Warning: No multitouch devices could be started. Falling back to event tap.\n");
 		}
+		if (!input_started)
+			start_event_tap();
+		startup_phase(g_tap_waiting ? "input (awaiting accessibility)" : "input");
 
-		g_tracks = CFDictionaryCreateMutable(NULL, 0,
-			&kCFTypeDictionaryKeyCallBacks,
-			NULL);
+		if (config.haptic)
+			open_haptics_async();
+		start_config_watch();
+		startup_phase("watch");
+		log_startup();
 
-		event_tap_begin(&g_event_tap, key_handler);
+		if (headless) {
+			CFRunLoopRun();
+			return 0;
+		}
 
 		// Set up NSApplication with our delegate for menu bar
 		NSApplication *app = [NSApplication sharedApplication];
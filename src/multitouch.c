@@ -0,0 +1,120 @@
+#include "log.h"
+#include "multitouch.h"
+
+#include <IOKit/IOKitLib.h>
+#include <os/lock.h>
+#include <stdio.h>
+
+#define CF_RELEASE(obj)      \
+	do {                     \
+		if ((obj) != NULL) { \
+			CFRelease(obj);  \
+			(obj) = NULL;    \
+		}                    \
+	} while (0)
+
+static const CFStringRef kMTRegistryKeyID = CFSTR("Multitouch ID");
+
+typedef struct {
+	MTDeviceRef device;
+	uint64_t id;
+} mt_device;
+
+static mt_device g_devices[MT_MAX_DEVICES];
+static int g_device_count = 0;
+static multitouch_frame_callback g_frame_callback = NULL;
+
+// Each device may call back on its own thread; the consumer side expects a
+// single producer, so frames are serialized here. Uncontended with one pad.
+static os_unfair_lock g_frame_lock = OS_UNFAIR_LOCK_INIT;
+
+static io_iterator_t matching_iterator(void)
+{
+	io_iterator_t it = MACH_PORT_NULL;
+	kern_return_t kr = IOServiceGetMatchingServices(
+		kIOMainPortDefault,
+		IOServiceMatching("AppleMultitouchDevice"),
+		&it);
+	if (kr != KERN_SUCCESS)
+		return MACH_PORT_NULL;
+
+	return it;
+}
+
+void multitouch_iterate_devices(void (^callback)(uint64_t devID))
+{
+	io_iterator_t iter = matching_iterator();
+	if (iter == MACH_PORT_NULL)
+		return;
+
+	io_object_t dev;
+	while ((dev = IOIteratorNext(iter))) {
+
+		CFNumberRef idRef = (CFNumberRef)
+			IORegistryEntryCreateCFProperty(dev, kMTRegistryKeyID,
+				kCFAllocatorDefault, 0);
+
+		if (idRef && CFGetTypeID(idRef) == CFNumberGetTypeID()) {
+			uint64_t id = 0;
+			CFNumberGetValue(idRef, kCFNumberSInt64Type, &id);
+			callback(id);
+		}
+
+		CF_RELEASE(idRef);
+		IOObjectRelease(dev);
+	}
+
+	IOObjectRelease(iter);
+}
+
+static int contact_frame(MTDeviceRef device, mt_contact* contacts, int count, double timestamp, __unused int frame)
+{
+	uint64_t id = 0;
+	for (int i = 0; i < g_device_count; ++i) {
+		if (g_devices[i].device == device) {
+			id = g_devices[i].id;
+			break;
+		}
+	}
+
+	os_unfair_lock_lock(&g_frame_lock);
+	g_frame_callback(id, contacts, count, timestamp);
+	os_unfair_lock_unlock(&g_frame_lock);
+	return 0;
+}
+
+bool multitouch_start(multitouch_frame_callback callback)
+{
+	if (g_device_count)
+		return true;
+
+	g_frame_callback = callback;
+	multitouch_iterate_devices(^(uint64_t id) {
+		if (g_device_count >= MT_MAX_DEVICES)
+			return;
+
+		MTDeviceRef device = MTDeviceCreateFromDeviceID(id);
+		if (!device) {
+			log_warn("No multitouch device for id %llu\n", (unsigned long long)id);
+			return;
+		}
+
+		g_devices[g_device_count++] = (mt_device) { .device = device, .id = id };
+		MTRegisterContactFrameCallback(device, contact_frame);
+		MTDeviceStart(device, 0);
+	});
+
+	return g_device_count > 0;
+}
+
+void multitouch_stop(void)
+{
+	for (int i = 0; i < g_device_count; ++i) {
+		MTDeviceRef device = g_devices[i].device;
+		MTUnregisterContactFrameCallback(device, contact_frame);
+		if (MTDeviceIsRunning(device))
+			MTDeviceStop(device);
+		CFRelease(device);
+	}
+	g_device_count = 0;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <CoreFoundation/CoreFoundation.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Private MultitouchSupport contact layout, as delivered to frame callbacks.
+typedef struct {
+	float x, y;
+} mt_point;
+
+typedef struct {
+	mt_point position, velocity;
+} mt_vector;
+
+typedef struct {
+	int frame;
+	double timestamp;
+	int identifier;
+	int state;
+	int finger_id;
+	int hand_id;
+	mt_vector normalized; // position 0..1, velocity in pad sizes per second
+	float size;
+	int zero1;
+	float angle;
+	float major_axis;
+	float minor_axis;
+	mt_vector absolute; // millimetres
+	int zero2[2];
+	float density;
+} mt_contact;
+
+typedef enum {
+	MT_STATE_NOT_TRACKING,
+	MT_STATE_START_IN_RANGE,
+	MT_STATE_HOVER_IN_RANGE,
+	MT_STATE_MAKE_TOUCH,
+	MT_STATE_TOUCHING,
+	MT_STATE_BREAK_TOUCH,
+	MT_STATE_LINGER_IN_RANGE,
+	MT_STATE_OUT_OF_RANGE
+} mt_state;
+
+typedef void* MTDeviceRef;
+typedef int (*MTContactCallbackFunction)(MTDeviceRef device, mt_contact* contacts, int count, double timestamp, int frame);
+
+extern MTDeviceRef MTDeviceCreateFromDeviceID(uint64_t deviceID);
+extern void MTRegisterContactFrameCallback(MTDeviceRef device, MTContactCallbackFunction callback);
+extern void MTUnregisterContactFrameCallback(MTDeviceRef device, MTContactCallbackFunction callback);
+extern void MTDeviceStart(MTDeviceRef device, int mode);
+extern void MTDeviceStop(MTDeviceRef device);
+extern bool MTDeviceIsRunning(MTDeviceRef device);
+
+#define MT_MAX_DEVICES 8
+
+typedef void (*multitouch_frame_callback)(uint64_t device_id, const mt_contact* contacts, int count, double timestamp);
+
+// Calls `callback` with the Multitouch ID of every AppleMultitouchDevice.
+void multitouch_iterate_devices(void (^callback)(uint64_t devID));
+
+// Registers a contact-frame callback on every multitouch device.
+// Frames arrive on MultitouchSupport's own thread. Returns false if no
+// device could be started.
+bool multitouch_start(multitouch_frame_callback callback);
+void multitouch_stop(void);
@@ -0,0 +1,86 @@
+// Synthetic-contact checks for palm rejection, run by `make check`.
+//
+//   palm-check
+//
+// Each scenario feeds frames shaped like what the event tap delivers through
+// palm_tracker_filter and checks which touches reach the gesture states.
+// Prints one line per scenario and exits non-zero if any fails.
+#include <stdio.h>
+#include <stdlib.h>
+
+#import "palm_tracker.h"
+
+#define CHECK_HZ 120.0
+#define CHECK_FRAMES 60 // 0.5s, well past the default palm_age
+
+static const palm_params check_params = { 0.025f, 0.06, 0.1f };
+
+static touch contact(uint64_t identity, double x, double y, int phase, double timestamp)
+{
+	return (touch) { .x = x, .y = y, .phase = phase, .timestamp = timestamp, .identity = identity };
+}
+
+// Three fingers swipe right while a palm rests near the corner. The palm is
+// reported stationary on most frames and only jitters on the others, so if
+// stationary contacts were not tracked it would be swept as lifted and come
+// back as a fresh contact that never reaches palm_age.
+static bool check_resting_palm(void)
+{
+	palm_tracker tracker = { 0 };
+	int leaked = 0, palm_frames = 0;
+
+	for (int f = 0; f < CHECK_FRAMES; ++f) {
+		double ts = f / CHECK_HZ;
+		touch touches[MAX_TOUCHES];
+		int n = 0;
+		for (int i = 0; i < 3; ++i)
+			touches[n++] = contact(i + 1, 0.2 + 0.012 * f, 0.4 + 0.1 * i, NSTouchPhaseMoved, ts);
+
+		bool moved = f % 4 == 0;
+		touches[n++] = contact(9, 0.8 + (moved ? 0.0005 * (f % 8 ? 1 : -1) : 0), 0.2,
+			moved ? NSTouchPhaseMoved : STATIONARY_PHASE, ts);
+
+		int kept = palm_tracker_filter(&tracker, touches, n, 3, &check_params);
+		if (!moved || ts < check_params.age + 1 / CHECK_HZ)
+			continue;
+
+		palm_frames++;
+		bool palm_kept = false;
+		for (int i = 0; i < kept; ++i)
+			palm_kept |= touches[i].identity == 9;
+		if (palm_kept || kept != 3)
+			leaked++;
+	}
+
+	bool ok = palm_frames && !leaked && tracker.rejected == 1;
+	printf("%-28s %s (%d of %d moved palm frames leaked, %llu rejected)\n", "resting palm", ok ? "ok" : "FAIL",
+		leaked, palm_frames, (unsigned long long)tracker.rejected);
+	return ok;
+}
+
+// A contact that stops moving for a while is still the same contact: it is
+// not forwarded while stationary, and forwarded again once it moves.
+static bool check_paused_finger(void)
+{
+	palm_tracker tracker = { 0 };
+	bool ok = true;
+
+	for (int f = 0; f < CHECK_FRAMES; ++f) {
+		bool paused = f >= 10 && f < 40;
+		touch t = contact(1, 0.5, 0.5, paused ? STATIONARY_PHASE : NSTouchPhaseMoved, f / CHECK_HZ);
+		int kept = palm_tracker_filter(&tracker, &t, 1, 3, &check_params);
+		ok &= kept == (paused ? 0 : 1);
+	}
+	ok &= tracker.count == 1 && tracker.rejected == 0;
+
+	printf("%-28s %s\n", "paused finger", ok ? "ok" : "FAIL");
+	return ok;
+}
+
+int main(void)
+{
+	bool ok = true;
+	ok &= check_resting_palm();
+	ok &= check_paused_finger();
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
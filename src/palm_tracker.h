@@ -0,0 +1,132 @@
+#pragma once
+#import "event_tap.h"
+#include <math.h>
+#include <stdatomic.h>
+
+// Twice MAX_TOUCHES: every contact of a frame fits even while the previous
+// frame's lifted contacts are still being swept.
+#define PALM_TRACKS (2 * MAX_TOUCHES)
+
+// Per-contact history for palm rejection, keyed by touch.identity. Fixed
+// capacity and linear scans: there are rarely more than five contacts.
+typedef struct {
+	finger_track tracks[PALM_TRACKS];
+	int count;
+	_Atomic uint64_t rejected; // contacts classified as palms
+} palm_tracker;
+
+typedef struct {
+	float disp; // a palm stays within this distance of where it landed
+	double age; // ...for at least this long
+	float velocity; // ...and moves slower than this
+} palm_params;
+
+static inline finger_track* palm_tracker_track(palm_tracker* tracker, const touch* t)
+{
+	for (int i = 0; i < tracker->count; ++i) {
+		if (tracker->tracks[i].identity == t->identity)
+			return &tracker->tracks[i];
+	}
+	if (tracker->count >= PALM_TRACKS)
+		return NULL;
+
+	finger_track* track = &tracker->tracks[tracker->count++];
+	memset(track, 0, sizeof(*track));
+	track->identity = t->identity;
+	track->start = track->last = CGPointMake(t->x, t->y);
+	track->t_start = track->t_last = t->timestamp;
+	return track;
+}
+
+// Updates the tracks from one frame and sets is_palm on its touches. Only
+// contacts beyond the configured finger count are ever classified, so a
+// normal gesture is never filtered: while there are more contacts than
+// `fingers`, the stillest contacts that have rested for params->age are
+// marked as palms. A palm stays one until it lifts or starts travelling.
+// Returns the number of touches marked.
+static inline int palm_tracker_update(palm_tracker* tracker, touch* touches, int count, int fingers,
+	const palm_params* params)
+{
+	finger_track* tracks[MAX_TOUCHES];
+
+	for (int i = 0; i < tracker->count; ++i)
+		tracker->tracks[i].seen = false;
+
+	for (int i = 0; i < count; ++i) {
+		finger_track* track = palm_tracker_track(tracker, &touches[i]);
+		tracks[i] = track;
+		if (!track)
+			continue;
+
+		CGPoint pos = CGPointMake(touches[i].x, touches[i].y);
+		double dt = touches[i].timestamp - track->t_last;
+		if (dt > 0)
+			track->speed = hypot(pos.x - track->last.x, pos.y - track->last.y) / dt;
+		track->last = pos;
+		track->t_last = touches[i].timestamp;
+		track->travel = hypot(pos.x - track->start.x, pos.y - track->start.y);
+		track->seen = true;
+
+		if (track->is_palm && track->travel >= params->disp)
+			track->is_palm = false;
+	}
+
+	// Contacts missing from this frame have lifted. Sweeping moves tracks,
+	// so the pointers above are only refreshed afterwards.
+	int kept = 0;
+	for (int i = 0; i < tracker->count; ++i) {
+		if (tracker->tracks[i].seen)
+			tracker->tracks[kept++] = tracker->tracks[i];
+	}
+	tracker->count = kept;
+	for (int i = 0; i < count; ++i)
+		tracks[i] = palm_tracker_track(tracker, &touches[i]);
+
+	int palms = 0;
+	for (int i = 0; i < count; ++i) {
+		if (tracks[i] && tracks[i]->is_palm)
+			palms++;
+	}
+
+	while (count - palms > fingers) {
+		finger_track* stillest = NULL;
+		for (int i = 0; i < count; ++i) {
+			finger_track* track = tracks[i];
+			if (!track || track->is_palm)
+				continue;
+			if (touches[i].timestamp - track->t_start < params->age || track->travel >= params->disp
+				|| track->speed >= params->velocity)
+				continue;
+			if (!stillest || track->travel < stillest->travel)
+				stillest = track;
+		}
+		if (!stillest)
+			break;
+
+		stillest->is_palm = true;
+		palms++;
+		atomic_fetch_add_explicit(&tracker->rejected, 1, memory_order_relaxed);
+	}
+
+	for (int i = 0; i < count; ++i)
+		touches[i].is_palm = tracks[i] && tracks[i]->is_palm;
+	return palms;
+}
+
+// Runs the tracker over every contact of a frame and compacts the touches
+// the gesture states get to the front: neither palms nor stationary.
+// Stationary contacts must still be tracked, since a resting palm is mostly
+// reported stationary and a track missing from a frame is swept as lifted.
+// Returns how many were kept.
+static inline int palm_tracker_filter(palm_tracker* tracker, touch* touches, int count, int fingers,
+	const palm_params* params)
+{
+	palm_tracker_update(tracker, touches, count, fingers, params);
+
+	int kept = 0;
+	for (int i = 0; i < count; ++i) {
+		if (!touches[i].is_palm && touches[i].phase != STATIONARY_PHASE)
+			touches[kept++] = touches[i];
+	}
+	return kept;
+}
@@ -0,0 +1,222 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "recording.h"
+
+// The file grows in steps of this much: a three finger frame is under 80
+// bytes, so a step lasts minutes of swiping.
+#define RECORDING_GROW_BYTES ((size_t)4 << 20)
+// Address space mapped up front, so the file grows underneath the mapping
+// and appending never remaps. Hours of continuous touches.
+#define RECORDING_RESERVE_BYTES ((size_t)4 << 30)
+
+struct recording {
+	int fd;
+	uint8_t* map; // RECORDING_RESERVE_BYTES
+	_Atomic size_t length; // of the file, written by recording_grow()
+	size_t used; // header included
+	uint64_t frames;
+	uint64_t dropped; // appended while the file had no room
+};
+
+struct recording_reader {
+	uint8_t* map;
+	size_t mapped;
+	size_t offset;
+	size_t end;
+	uint64_t frames;
+	uint64_t read;
+};
+
+static void recording_write_header(recording* rec)
+{
+	recording_header* header = (recording_header*)rec->map;
+	header->frames = rec->frames;
+	header->length = rec->used - sizeof(recording_header);
+}
+
+recording* recording_create(const char* path)
+{
+	recording* rec = calloc(1, sizeof(*rec));
+	if (!rec)
+		return NULL;
+
+	rec->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (rec->fd < 0) {
+		fprintf(stderr, "Error: Could not create recording '%s': %s\n", path, strerror(errno));
+		free(rec);
+		return NULL;
+	}
+	rec->map = MAP_FAILED;
+	if (ftruncate(rec->fd, (off_t)RECORDING_GROW_BYTES) == 0)
+		rec->map = mmap(NULL, RECORDING_RESERVE_BYTES, PROT_READ | PROT_WRITE, MAP_SHARED, rec->fd, 0);
+	if (rec->map == MAP_FAILED) {
+		fprintf(stderr, "Error: Could not map recording '%s': %s\n", path, strerror(errno));
+		close(rec->fd);
+		free(rec);
+		return NULL;
+	}
+	atomic_init(&rec->length, RECORDING_GROW_BYTES);
+
+	recording_header* header = (recording_header*)rec->map;
+	memcpy(header->magic, RECORDING_MAGIC, sizeof(header->magic));
+	header->version = RECORDING_VERSION;
+	header->max_touches = MAX_TOUCHES;
+	rec->used = sizeof(recording_header);
+	recording_write_header(rec);
+	return rec;
+}
+
+bool recording_append(recording* rec, const touch_frame* frame)
+{
+	size_t size = sizeof(recording_frame) + (size_t)frame->count * sizeof(recording_touch);
+	if (rec->used + size > RECORDING_RESERVE_BYTES)
+		return false;
+	if (rec->used + size > atomic_load_explicit(&rec->length, memory_order_acquire)) {
+		rec->dropped++;
+		return true;
+	}
+
+	recording_frame* out = (recording_frame*)(rec->map + rec->used);
+	out->timestamp = frame->timestamp;
+	out->count = (uint32_t)frame->count;
+	out->pad = (uint32_t)frame->pad;
+
+	recording_touch* touches = (recording_touch*)(out + 1);
+	for (int i = 0; i < frame->count; ++i) {
+		touches[i] = (recording_touch) {
+			frame->x[i], frame->y[i], frame->vx[i], frame->vy[i], frame->phase[i]
+		};
+	}
+
+	rec->used += size;
+	rec->frames++;
+	recording_write_header(rec);
+	return true;
+}
+
+bool recording_wants_growth(const recording* rec)
+{
+	size_t length = atomic_load_explicit(&rec->length, memory_order_relaxed);
+	return length < RECORDING_RESERVE_BYTES && rec->used + RECORDING_GROW_BYTES / 2 > length;
+}
+
+bool recording_grow(recording* rec)
+{
+	size_t length = atomic_load_explicit(&rec->length, memory_order_relaxed) + RECORDING_GROW_BYTES;
+	if (length > RECORDING_RESERVE_BYTES)
+		length = RECORDING_RESERVE_BYTES;
+	if (ftruncate(rec->fd, (off_t)length) != 0)
+		return false;
+
+	atomic_store_explicit(&rec->length, length, memory_order_release);
+	return true;
+}
+
+void recording_close(recording* rec)
+{
+	if (!rec)
+		return;
+
+	if (rec->dropped)
+		fprintf(stderr, "Warning: %llu frames did not fit in the recording.\n", (unsigned long long)rec->dropped);
+	recording_write_header(rec);
+	munmap(rec->map, RECORDING_RESERVE_BYTES);
+	if (ftruncate(rec->fd, (off_t)rec->used) != 0)
+		fprintf(stderr, "Warning: Could not trim recording: %s\n", strerror(errno));
+	close(rec->fd);
+	free(rec);
+}
+
+recording_reader* recording_open(const char* path)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "Error: Could not open recording '%s': %s\n", path, strerror(errno));
+		return NULL;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(recording_header)) {
+		fprintf(stderr, "Error: '%s' is not a recording.\n", path);
+		close(fd);
+		return NULL;
+	}
+
+	uint8_t* map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		fprintf(stderr, "Error: Could not map recording '%s': %s\n", path, strerror(errno));
+		return NULL;
+	}
+
+	const recording_header* header = (const recording_header*)map;
+	if (memcmp(header->magic, RECORDING_MAGIC, sizeof(header->magic)) != 0
+		|| header->version != RECORDING_VERSION || header->max_touches != MAX_TOUCHES) {
+		fprintf(stderr, "Error: '%s' is not a version %d recording.\n", path, RECORDING_VERSION);
+		munmap(map, (size_t)st.st_size);
+		return NULL;
+	}
+
+	recording_reader* reader = calloc(1, sizeof(*reader));
+	if (!reader) {
+		munmap(map, (size_t)st.st_size);
+		return NULL;
+	}
+	reader->map = map;
+	reader->mapped = (size_t)st.st_size;
+	reader->offset = sizeof(recording_header);
+	reader->end = reader->offset + header->length;
+	if (reader->end > reader->mapped)
+		reader->end = reader->mapped;
+	reader->frames = header->frames;
+	return reader;
+}
+
+bool recording_next(recording_reader* reader, touch_frame* frame)
+{
+	if (reader->read >= reader->frames || reader->offset + sizeof(recording_frame) > reader->end)
+		return false;
+
+	const recording_frame* in = (const recording_frame*)(reader->map + reader->offset);
+	size_t size = sizeof(recording_frame) + (size_t)in->count * sizeof(recording_touch);
+	if (in->count > MAX_TOUCHES || reader->offset + size > reader->end)
+		return false;
+
+	frame->timestamp = in->timestamp;
+	frame->count = (int)in->count;
+	frame->pad = (int)in->pad;
+	const recording_touch* touches = (const recording_touch*)(in + 1);
+	for (int i = 0; i < frame->count; ++i) {
+		frame->x[i] = touches[i].x;
+		frame->y[i] = touches[i].y;
+		frame->vx[i] = touches[i].vx;
+		frame->vy[i] = touches[i].vy;
+		frame->phase[i] = touches[i].phase;
+	}
+
+	reader->offset += size;
+	reader->read++;
+	return true;
+}
+
+uint64_t recording_frame_count(const recording_reader* reader)
+{
+	return reader->frames;
+}
+
+void recording_reader_close(recording_reader* reader)
+{
+	if (!reader)
+		return;
+
+	munmap(reader->map, reader->mapped);
+	free(reader);
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "touch_ring.h"
+
+#define RECORDING_MAGIC "SWIPEREC"
+#define RECORDING_VERSION 1
+
+// A recording is this header followed by one variable-length record per
+// frame: the frame timestamp, touch count and pad, then that many
+// recording_touch. The header is rewritten after every frame, so a
+// recording that was never closed (crash, kill -9) still reads back up to
+// its last complete frame.
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t max_touches;
+	uint64_t frames;
+	uint64_t length; // bytes of records after the header
+} recording_header;
+
+typedef struct {
+	double timestamp;
+	uint32_t count;
+	uint32_t pad; // touch_frame.pad; always 0 in recordings that predate it
+} recording_frame;
+
+typedef struct {
+	float x, y, vx, vy;
+	int32_t phase;
+} recording_touch;
+
+typedef struct recording recording;
+typedef struct recording_reader recording_reader;
+
+// Creates (or truncates) `path` and maps it for writing. Returns NULL with
+// a message on stderr if it cannot.
+recording* recording_create(const char* path);
+
+// Copies one frame into the mapping. Never touches the filesystem, so it is
+// safe on the input thread: a frame the file has no room for yet is dropped
+// and counted. Returns false once the whole reservation is used up.
+bool recording_append(recording* rec, const touch_frame* frame);
+
+// Whether the file is getting close to full and recording_grow() should be
+// called. Same thread as recording_append().
+bool recording_wants_growth(const recording* rec);
+
+// Extends the file by one step. May block on the filesystem; can run on any
+// thread, concurrently with recording_append(). Returns false on failure.
+bool recording_grow(recording* rec);
+
+// Trims the file to its contents and unmaps it. Nothing may be appending.
+void recording_close(recording* rec);
+
+recording_reader* recording_open(const char* path);
+
+// Fills `frame` with the next recorded frame. Returns false at the end of
+// the recording.
+bool recording_next(recording_reader* reader, touch_frame* frame);
+
+uint64_t recording_frame_count(const recording_reader* reader);
+
+void recording_reader_close(recording_reader* reader);
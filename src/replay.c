@@ -0,0 +1,181 @@
+// Headless replay of a `swipe --record` file through the gesture state
+// machine, for tuning and regression-testing configs without a trackpad.
+//
+//   replay [-c config.json] [-s sensitivity] [-f fingers] recording
+//
+// Prints every arm, abandon and fire with its time into the recording and
+// the detection latency from touch-down and from arming, then a summary.
+// Frames are fed one by one, as with coalesce_frames off, each to the
+// gesture state of the pad it was recorded from.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "gesture.h"
+#include "recording.h"
+
+#define REPLAY_PADS 8 // as MT_MAX_DEVICES
+
+typedef struct {
+	double origin; // timestamp of the first frame
+	unsigned arms, abandons, fires, steps;
+	double arm_latency_sum, arm_latency_max;
+	double down_latency_sum, down_latency_max;
+} replay_state;
+
+// Whatever swipe ties to one pad: its gesture and contact.
+typedef struct {
+	replay_state* state;
+	int index;
+	double touch_down; // first frame of the current contact
+	double armed_at;
+	bool touching;
+	gesture_ctx gesture;
+} replay_pad;
+
+// Events are only tagged with the pad past the first, so single-pad
+// recordings print as they always have.
+static void print_event(const replay_pad* pad, double timestamp, const char* event)
+{
+	if (pad->index)
+		printf("%9.3fs  pad %d %s\n", timestamp - pad->state->origin, pad->index, event);
+	else
+		printf("%9.3fs  %s\n", timestamp - pad->state->origin, event);
+}
+
+static void on_armed(void* context, double timestamp)
+{
+	replay_pad* pad = context;
+	pad->armed_at = timestamp;
+	pad->state->arms++;
+	print_event(pad, timestamp, "arm");
+}
+
+static void on_abandoned(void* context, double timestamp)
+{
+	replay_pad* pad = context;
+	pad->state->abandons++;
+	print_event(pad, timestamp, "abandon");
+}
+
+static void on_fire(void* context, int fingers, swipe_direction direction, int count, double timestamp)
+{
+	replay_pad* pad = context;
+	replay_state* state = pad->state;
+	double from_arm = (timestamp - pad->armed_at) * 1000.0;
+	double from_down = (timestamp - pad->touch_down) * 1000.0;
+	state->fires++;
+	state->steps += count;
+	state->arm_latency_sum += from_arm;
+	state->down_latency_sum += from_down;
+	if (from_arm > state->arm_latency_max)
+		state->arm_latency_max = from_arm;
+	if (from_down > state->down_latency_max)
+		state->down_latency_max = from_down;
+	char event[96];
+	snprintf(event, sizeof(event), "fire %d-finger %s x%d  %.1fms after arm, %.1fms after touch-down", fingers,
+		SWIPE_DIRECTION_NAMES[direction], count, from_arm, from_down);
+	print_event(pad, timestamp, event);
+}
+
+// Contacts start on the first frame with a live touch after one with none.
+static void track_contact(replay_pad* pad, const touch_frame* frame)
+{
+	int live = 0;
+	for (int i = 0; i < frame->count; ++i) {
+		if (frame->phase[i] != END_PHASE)
+			live++;
+	}
+	if (live && !pad->touching)
+		pad->touch_down = frame->timestamp;
+	pad->touching = live > 0;
+}
+
+static void usage(const char* argv0)
+{
+	fprintf(stderr, "usage: %s [-c config.json] [-s sensitivity] [-f fingers] recording\n", argv0);
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char* argv[])
+{
+	const char* config_path = NULL;
+	int sensitivity = 0;
+	int fingers = 0;
+	int opt;
+	while ((opt = getopt(argc, argv, "c:s:f:")) != -1) {
+		switch (opt) {
+			case 'c':
+				config_path = optarg;
+				break;
+			case 's':
+				sensitivity = atoi(optarg);
+				break;
+			case 'f':
+				fingers = atoi(optarg);
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1)
+		usage(argv[0]);
+
+	// Without -c, start from the built-in defaults rather than whichever
+	// config.json happens to be installed, so runs are reproducible.
+	Config config = config_path ? load_config_from(config_path) : default_config();
+	if (sensitivity)
+		apply_sensitivity(&config, sensitivity);
+	if (fingers)
+		config.fingers = fingers;
+
+	recording_reader* reader = recording_open(argv[optind]);
+	if (!reader)
+		return EXIT_FAILURE;
+
+	replay_state state = { 0 };
+	static replay_pad pads[REPLAY_PADS];
+	for (int i = 0; i < REPLAY_PADS; ++i) {
+		gesture_hooks hooks = { on_armed, on_abandoned, on_fire, &pads[i] };
+		pads[i].state = &state;
+		pads[i].index = i;
+		gesture_init(&pads[i].gesture, &config, &hooks);
+	}
+
+	printf("%s: %llu frames, fingers=%d sensitivity=%d distance=%.3f fast=%.2fx@vel%.2f\n", argv[optind],
+		(unsigned long long)recording_frame_count(reader), config.fingers, config.sensitivity,
+		config.distance_pct, config.fast_distance_factor, config.fast_velocity_threshold);
+
+	static touch_frame frame;
+	uint64_t frames = 0, foreign = 0;
+	while (recording_next(reader, &frame)) {
+		if (!frames++)
+			state.origin = frame.timestamp;
+		if (frame.pad < 0 || frame.pad >= REPLAY_PADS) {
+			foreign++;
+			continue;
+		}
+		track_contact(&pads[frame.pad], &frame);
+		gesture_process(&pads[frame.pad].gesture, &frame);
+	}
+	recording_reader_close(reader);
+	if (foreign)
+		fprintf(stderr, "Warning: Skipped %llu frames from pads past %d.\n", (unsigned long long)foreign,
+			REPLAY_PADS - 1);
+
+	uint64_t predicted = 0, mispredicted = 0;
+	for (int i = 0; i < REPLAY_PADS; ++i) {
+		predicted += atomic_load(&pads[i].gesture.predicted_commits);
+		mispredicted += atomic_load(&pads[i].gesture.mispredicted);
+	}
+	printf("frames=%llu arms=%u abandoned=%u fires=%u steps=%u predicted=%llu mispredicted=%llu\n",
+		(unsigned long long)frames, state.arms, state.abandons, state.fires, state.steps,
+		(unsigned long long)predicted, (unsigned long long)mispredicted);
+	if (state.fires) {
+		printf("latency: from arm mean=%.1fms max=%.1fms, from touch-down mean=%.1fms max=%.1fms\n",
+			state.arm_latency_sum / state.fires, state.arm_latency_max,
+			state.down_latency_sum / state.fires, state.down_latency_max);
+	}
+	return EXIT_SUCCESS;
+}
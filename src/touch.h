@@ -0,0 +1,18 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+#define STATIONARY_PHASE 4 // NSTouchPhaseStationary
+#define END_PHASE 8 // NSTouchPhaseEnded
+#define MAX_TOUCHES 16
+
+typedef struct {
+	double x;
+	double y;
+	int phase;
+	double timestamp;
+	double velocity;
+	double velocity_y;
+	uint64_t identity; // stable for the life of the contact
+	bool is_palm;
+} touch;
@@ -0,0 +1,86 @@
+#pragma once
+#include <simd/simd.h>
+
+#include "touch_ring.h"
+
+_Static_assert(MAX_TOUCHES == 16, "touch_frame_summarize() works on simd_float16 lanes");
+
+// Index of each lane, for masking off the fingers past frame->count.
+static const simd_int16 TOUCH_LANES = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 };
+
+// Slow and fast variants of a per-finger threshold; which one applies is
+// only known once the frame's average velocity is.
+enum {
+	TOUCH_SLOW,
+	TOUCH_FAST
+};
+
+// Axis a swipe travels along; indexes the per-axis summary fields
+enum {
+	TOUCH_AXIS_X,
+	TOUCH_AXIS_Y
+};
+
+// Everything the gesture states read from one frame. The per-finger checks
+// are counted for both axes, both thresholds and both directions of travel,
+// so they are resolved with a lookup instead of another loop over the
+// fingers.
+typedef struct {
+	float avg[2], avg_vel[2]; // by axis
+	float min_x, max_x, min_y, max_y;
+	int ended; // fingers in END_PHASE
+	int moved[2][2]; // [axis][speed] |pos - base| >= travel
+	int stalled[2][2]; // |pos - prev| < step
+	int stalled_or_neg[2][2]; // ... or moved towards -axis since prev
+	int stalled_or_pos[2][2]; // ... or towards +axis
+} touch_summary;
+
+static inline simd_float16 touch_lanes_load(const float* v)
+{
+	return *(const simd_packed_float16*)v;
+}
+
+static inline int touch_lanes_count(simd_int16 mask)
+{
+	return -simd_reduce_add(mask); // true lanes are -1
+}
+
+// One pass over the frame: averages, bounds and the per-finger threshold
+// counts along both axes for a frame with at least one touch. base and prev
+// are indexed by axis.
+static inline void touch_frame_summarize(const touch_frame* frame, const float* const base[2],
+	const float* const prev[2], const float travel[2], const float step[2], touch_summary* out)
+{
+	simd_int16 active = TOUCH_LANES < frame->count;
+	simd_float16 zero = 0.0f;
+	simd_float16 one = 1.0f;
+	simd_float16 pos[2] = { touch_lanes_load(frame->x), touch_lanes_load(frame->y) };
+	simd_float16 vel[2] = { touch_lanes_load(frame->vx), touch_lanes_load(frame->vy) };
+	float n = (float)frame->count;
+
+	out->min_x = simd_reduce_min(simd_select(one, pos[TOUCH_AXIS_X], active));
+	out->max_x = simd_reduce_max(simd_select(zero, pos[TOUCH_AXIS_X], active));
+	out->min_y = simd_reduce_min(simd_select(one, pos[TOUCH_AXIS_Y], active));
+	out->max_y = simd_reduce_max(simd_select(zero, pos[TOUCH_AXIS_Y], active));
+
+	simd_int16 phase = *(const simd_packed_int16*)frame->phase;
+	out->ended = touch_lanes_count(active & (phase == END_PHASE));
+
+	for (int axis = TOUCH_AXIS_X; axis <= TOUCH_AXIS_Y; ++axis) {
+		out->avg[axis] = simd_reduce_add(simd_select(zero, pos[axis], active)) / n;
+		out->avg_vel[axis] = simd_reduce_add(simd_select(zero, vel[axis], active)) / n;
+
+		simd_float16 travelled = simd_abs(pos[axis] - touch_lanes_load(base[axis]));
+		simd_float16 delta = pos[axis] - touch_lanes_load(prev[axis]);
+		simd_float16 step_len = simd_abs(delta);
+		simd_int16 falling = delta < 0.0f;
+		simd_int16 rising = delta > 0.0f;
+		for (int k = TOUCH_SLOW; k <= TOUCH_FAST; ++k) {
+			simd_int16 stalled = active & (step_len < step[k]);
+			out->moved[axis][k] = touch_lanes_count(active & (travelled >= travel[k]));
+			out->stalled[axis][k] = touch_lanes_count(stalled);
+			out->stalled_or_neg[axis][k] = touch_lanes_count(stalled | (active & falling));
+			out->stalled_or_pos[axis][k] = touch_lanes_count(stalled | (active & rising));
+		}
+	}
+}
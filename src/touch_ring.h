@@ -0,0 +1,106 @@
+#pragma once
+#include "touch.h"
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Must be a power of two. 64 frames is ~0.5s of backlog at 120Hz.
+#define TOUCH_RING_CAPACITY 64
+
+// One frame of touches in SoA layout, so the per-frame reduction in
+// touch_kernel.h reads each field as whole vectors.
+typedef struct {
+	float x[MAX_TOUCHES] __attribute__((aligned(64)));
+	float y[MAX_TOUCHES] __attribute__((aligned(64)));
+	float vx[MAX_TOUCHES] __attribute__((aligned(64)));
+	float vy[MAX_TOUCHES] __attribute__((aligned(64)));
+	int phase[MAX_TOUCHES] __attribute__((aligned(64)));
+	double timestamp; // newest touch in the frame
+	uint64_t published; // latency_now() when committed
+	int count;
+	int pad; // index of the trackpad the frame came from
+} touch_frame;
+
+// Producer: appends one converted touch. The caller bounds count by
+// MAX_TOUCHES.
+static inline void touch_frame_append(touch_frame* frame, const touch* t)
+{
+	int i = frame->count++;
+	frame->x[i] = (float)t->x;
+	frame->y[i] = (float)t->y;
+	frame->vx[i] = (float)t->velocity;
+	frame->vy[i] = (float)t->velocity_y;
+	frame->phase[i] = t->phase;
+	if (t->timestamp > frame->timestamp)
+		frame->timestamp = t->timestamp;
+}
+
+// Single-producer/single-consumer ring of touch frames. The event tap
+// thread writes frames in place and the gesture consumer reads them back,
+// so the per-frame path never touches the heap.
+typedef struct {
+	touch_frame frames[TOUCH_RING_CAPACITY];
+	_Atomic uint32_t head __attribute__((aligned(64))); // written by producer
+	_Atomic uint32_t tail __attribute__((aligned(64))); // written by consumer
+	_Atomic uint64_t pushed; // frames accepted without allocating
+	_Atomic uint64_t dropped; // frames lost because the ring was full
+	_Atomic uint32_t high_water; // largest backlog seen by the producer
+} touch_ring;
+
+// Producer: returns the next free slot, or NULL if the consumer is a full
+// ring behind. The slot is only published by touch_ring_commit().
+static inline touch_frame* touch_ring_reserve(touch_ring* ring)
+{
+	uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+	if (head - tail >= TOUCH_RING_CAPACITY) {
+		atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+		return NULL;
+	}
+	return &ring->frames[head & (TOUCH_RING_CAPACITY - 1)];
+}
+
+static inline void touch_ring_commit(touch_ring* ring)
+{
+	uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+	uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+	atomic_fetch_add_explicit(&ring->pushed, 1, memory_order_relaxed);
+
+	uint32_t backlog = head + 1 - tail;
+	if (backlog > atomic_load_explicit(&ring->high_water, memory_order_relaxed))
+		atomic_store_explicit(&ring->high_water, backlog, memory_order_relaxed);
+}
+
+// Consumer: returns the oldest unread frame, or NULL if the ring is empty.
+// The frame stays valid until touch_ring_release().
+static inline touch_frame* touch_ring_peek(touch_ring* ring)
+{
+	uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+	if (tail == head)
+		return NULL;
+	return &ring->frames[tail & (TOUCH_RING_CAPACITY - 1)];
+}
+
+// Consumer: number of frames published but not yet released.
+static inline uint32_t touch_ring_pending(touch_ring* ring)
+{
+	uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+	return head - tail;
+}
+
+// Consumer: the frame `offset` places after the oldest one. Only valid for
+// offset < touch_ring_pending().
+static inline touch_frame* touch_ring_at(touch_ring* ring, uint32_t offset)
+{
+	uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	return &ring->frames[(tail + offset) & (TOUCH_RING_CAPACITY - 1)];
+}
+
+static inline void touch_ring_release(touch_ring* ring)
+{
+	uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+	atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+}
@@ -0,0 +1,133 @@
+#pragma once
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+// Twice MAX_TOUCHES, so the table never runs above 50% load. Power of two.
+#define TOUCH_TABLE_SLOTS 32
+
+// Per-finger history used to derive velocity between frames.
+typedef struct {
+	uint64_t key;
+	double x;
+	double y;
+	double timestamp;
+	double vx; // smoothed, pad sizes per second
+	double vy;
+	bool used;
+} touch_state;
+
+// One-euro-style velocity smoothing: the low-pass cutoff rises with speed,
+// so fast swipes see little lag while slow movement and tiny or coalesced
+// frame intervals barely move the estimate.
+typedef struct {
+	double min_cutoff; // Hz, at rest
+	double beta; // extra Hz per pad size per second
+} touch_filter;
+
+static inline double touch_filter_smooth(const touch_filter* filter, double estimate, double raw, double dt)
+{
+	double cutoff = filter->min_cutoff + filter->beta * fabs(estimate);
+	double tau = 1.0 / (2.0 * M_PI * cutoff);
+	double alpha = dt / (dt + tau);
+	return estimate + alpha * (raw - estimate);
+}
+
+// Folds a new sample into the state. The first sample of a touch only
+// seeds the position.
+static inline void touch_state_update(touch_state* state, const touch_filter* filter, bool created,
+	double x, double y, double timestamp)
+{
+	double dt = timestamp - state->timestamp;
+	if (!created && dt > 0) {
+		state->vx = touch_filter_smooth(filter, state->vx, (x - state->x) / dt, dt);
+		state->vy = touch_filter_smooth(filter, state->vy, (y - state->y) / dt, dt);
+	}
+	state->x = x;
+	state->y = y;
+	state->timestamp = timestamp;
+}
+
+// Fixed open-addressing table (linear probing, backward-shift deletion).
+// Lives inline in the converter so fingers landing and lifting never
+// allocate.
+typedef struct {
+	touch_state slots[TOUCH_TABLE_SLOTS];
+	int count;
+} touch_table;
+
+static inline uint32_t touch_table_hash(uint64_t key)
+{
+	key ^= key >> 33;
+	key *= 0xff51afd7ed558ccdULL;
+	key ^= key >> 33;
+	return (uint32_t)key & (TOUCH_TABLE_SLOTS - 1);
+}
+
+static inline touch_state* touch_table_find(touch_table* table, uint64_t key)
+{
+	for (uint32_t i = touch_table_hash(key), n = 0; n < TOUCH_TABLE_SLOTS; i = (i + 1) & (TOUCH_TABLE_SLOTS - 1), ++n) {
+		touch_state* slot = &table->slots[i];
+		if (!slot->used)
+			return NULL;
+		if (slot->key == key)
+			return slot;
+	}
+	return NULL;
+}
+
+static inline void touch_table_remove(touch_table* table, touch_state* slot)
+{
+	uint32_t hole = (uint32_t)(slot - table->slots);
+	slot->used = false;
+	table->count--;
+
+	// Shift later members of the probe run back so lookups never stop early.
+	for (uint32_t i = (hole + 1) & (TOUCH_TABLE_SLOTS - 1);; i = (i + 1) & (TOUCH_TABLE_SLOTS - 1)) {
+		touch_state* next = &table->slots[i];
+		if (!next->used)
+			return;
+
+		uint32_t home = touch_table_hash(next->key);
+		bool movable = (hole <= i) ? (home <= hole || home > i) : (home <= hole && home > i);
+		if (movable) {
+			table->slots[hole] = *next;
+			next->used = false;
+			hole = i;
+		}
+	}
+}
+
+// Returns the slot for key, inserting a fresh one if needed. Touches that
+// vanish without an end phase would otherwise pile up, so a full table
+// recycles its stalest entry.
+static inline touch_state* touch_table_insert(touch_table* table, uint64_t key, bool* created)
+{
+	touch_state* slot = touch_table_find(table, key);
+	*created = (slot == NULL);
+	if (slot)
+		return slot;
+
+	if (table->count >= TOUCH_TABLE_SLOTS / 2) {
+		touch_state* stalest = NULL;
+		for (int i = 0; i < TOUCH_TABLE_SLOTS; ++i) {
+			touch_state* s = &table->slots[i];
+			if (s->used && (!stalest || s->timestamp < stalest->timestamp))
+				stalest = s;
+		}
+		if (stalest)
+			touch_table_remove(table, stalest);
+	}
+
+	uint32_t i = touch_table_hash(key);
+	while (table->slots[i].used)
+		i = (i + 1) & (TOUCH_TABLE_SLOTS - 1);
+
+	slot = &table->slots[i];
+	memset(slot, 0, sizeof(*slot));
+	slot->key = key;
+	slot->used = true;
+	table->count++;
+	return slot;
+}
@@ -0,0 +1,122 @@
+#pragma once
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WORKSPACE_MODEL_MAX 64
+#define WORKSPACE_NAME_MAX 64
+
+// Ordered workspaces of the focused monitor, as `list-workspaces --monitor
+// focused` reports them, plus which are empty and which has focus. Enough to
+// resolve next/prev locally and send AeroSpace a single `workspace <name>`.
+typedef struct {
+	char names[WORKSPACE_MODEL_MAX][WORKSPACE_NAME_MAX];
+	bool empty[WORKSPACE_MODEL_MAX];
+	int count;
+	int focused; // index into names, -1 when focus is on another monitor
+} workspace_model;
+
+static inline void workspace_model_reset(workspace_model* model)
+{
+	model->count = 0;
+	model->focused = -1;
+}
+
+static inline int workspace_model_find(const workspace_model* model, const char* name, size_t len)
+{
+	for (int i = 0; i < model->count; ++i) {
+		if (strncmp(model->names[i], name, len) == 0 && model->names[i][len] == '\0')
+			return i;
+	}
+	return -1;
+}
+
+// Calls fn for each non-blank line of `output`. Stops and returns false as
+// soon as fn does.
+static inline bool workspace_model_each_line(workspace_model* model, const char* output,
+	bool (*fn)(workspace_model*, const char*, size_t))
+{
+	for (const char* line = output; line && *line;) {
+		const char* end = strchr(line, '\n');
+		size_t len = end ? (size_t)(end - line) : strlen(line);
+		if (len && !fn(model, line, len))
+			return false;
+		line = end ? end + 1 : line + len;
+	}
+	return true;
+}
+
+static inline bool workspace_model_add_name(workspace_model* model, const char* name, size_t len)
+{
+	if (model->count >= WORKSPACE_MODEL_MAX || len >= WORKSPACE_NAME_MAX)
+		return false;
+	memcpy(model->names[model->count], name, len);
+	model->names[model->count][len] = '\0';
+	model->empty[model->count] = true;
+	model->count++;
+	return true;
+}
+
+static inline bool workspace_model_mark_occupied(workspace_model* model, const char* name, size_t len)
+{
+	int i = workspace_model_find(model, name, len);
+	if (i >= 0)
+		model->empty[i] = false;
+	return true;
+}
+
+static inline bool workspace_model_mark_focused(workspace_model* model, const char* name, size_t len)
+{
+	model->focused = workspace_model_find(model, name, len);
+	return true;
+}
+
+// Feed the three list-workspaces outputs in this order. Returns false if the
+// monitor has more workspaces, or longer names, than the model can hold.
+static inline bool workspace_model_parse_all(workspace_model* model, const char* output)
+{
+	workspace_model_reset(model);
+	return workspace_model_each_line(model, output, workspace_model_add_name);
+}
+
+// Also refreshes the occupancy of a complete model on its own.
+static inline void workspace_model_parse_occupied(workspace_model* model, const char* output)
+{
+	for (int i = 0; i < model->count; ++i)
+		model->empty[i] = true;
+	workspace_model_each_line(model, output, workspace_model_mark_occupied);
+}
+
+static inline void workspace_model_parse_focused(workspace_model* model, const char* output)
+{
+	model->focused = -1;
+	workspace_model_each_line(model, output, workspace_model_mark_focused);
+}
+
+// Index of the workspace `steps` positions from the focused one (negative
+// steps go backwards). Without wrap_around the walk stops at the ends, so a
+// long flick lands on the last workspace rather than doing nothing. Returns
+// -1 if there is nowhere to go.
+static inline int workspace_model_target(const workspace_model* model, int steps, bool skip_empty, bool wrap_around)
+{
+	if (model->focused < 0 || model->count == 0 || steps == 0)
+		return -1;
+
+	int dir = steps > 0 ? 1 : -1;
+	int remaining = abs(steps);
+	int index = model->focused;
+	int target = -1;
+	for (int walked = 0; remaining > 0 && walked < model->count * abs(steps); ++walked) {
+		index += dir;
+		if (index < 0 || index >= model->count) {
+			if (!wrap_around)
+				break;
+			index = (index + model->count) % model->count;
+		}
+		if (skip_empty && model->empty[index] && index != model->focused)
+			continue;
+		target = index;
+		remaining--;
+	}
+	return target == model->focused ? -1 : target;
+}